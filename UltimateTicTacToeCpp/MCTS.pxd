@@ -12,6 +12,21 @@ cdef extern from "src/MonteCarlo.cpp":
 cdef extern from "src/BatchManager.cpp":
     pass
 
+cdef extern from "src/ParallelMCTS.cpp":
+    pass
+
+cdef extern from "src/NNCache.cpp":
+    pass
+
+cdef extern from "src/Rollout.cpp":
+    pass
+
+cdef extern from "src/OpeningBook.cpp":
+    pass
+
+cdef extern from "include/OpeningBook.h":
+    cdef boolean loadOpeningBook(string filename)
+
 cdef extern from "limits.h":
     cdef float FLT_MAX
 
@@ -41,10 +56,14 @@ cdef extern from "include/GameState.h":
 
         vector[int] getCanonicalBoard()
         vector[int] getBoardBitset()
+        board2D get2DCanonicalBoard()
 
         boardCoords previousMove
 
 cdef extern from "include/MonteCarlo.h":
+    cdef int GUMBEL_TOP_K_DEFAULT
+
+
     cdef struct trainingExampleVector:
         vector[int] canonicalBoard
         float result
@@ -62,16 +81,35 @@ cdef extern from "include/MonteCarlo.h":
         MCTS(float _cpuct, double dirichlet_a, float percent_q)
 
         void startNewSearch(GameState position)
-        void backpropagate(Node *finalNode, float result)
+        void backpropagate(unsigned int finalNode, float result)
 
         board2D searchPreNN()
 
         void searchPostNN(vector[float] policy, float v)
 
+        vector[board2D] searchPreNN(int numLeaves)
+        void searchPostNN(vector[vector[float]] policies, vector[float] values)
+        float virtualLoss
+        unsigned int nodeBudget
+        boolean freezeOnBudget
+        int prunes
+        size_t memoryUsage()
+        boolean gumbelRoot
+        int gumbelTopK
+        void startGumbelSearch(int sims)
+        vector[float] getImprovedPolicy()
+        int getGumbelAction(boolean withNoise)
+
         boolean evaluationNeeded
 
         vector[float] getActionProb()
+        int getBookAction()
+        boolean useOpeningBook
+        int solverSpots
         void takeAction(int actionIndex)
+        void takeAction(int actionIndex, float reuseFraction)
+        boolean saveTree(string filename, int maxDepth, unsigned int minVisits)
+        boolean loadTree(string filename)
         int getStatus()
         void displayGame()
         string gameToString()
@@ -83,7 +121,29 @@ cdef extern from "include/MonteCarlo.h":
     vector[trainingExample2D] convertTo2D(vector[trainingExampleVector] positions)
 
 
+cdef extern from "include/NNCache.h":
+    cdef int NN_CACHE_SIZE_DEFAULT
+
+    cdef cppclass nnCacheStats:
+        long long probes, hits, stores, evictions
+
+        double hitRate()
+
+
+cdef extern from "include/Rollout.h":
+    cdef int ROLLOUTS_PER_LEAF_DEFAULT
+
+    cdef cppclass uctOptions:
+        int rolloutsPerLeaf
+        boolean heuristicPriors
+
+
 cdef extern from "include/BatchManager.h":
+    cdef int WORKER_NODE_BUDGET_DEFAULT
+
+    cdef cppclass treeMemoryStats:
+        long long peakTreeBytes, peakWorkerBytes, prunes
+
     cdef struct batch:
         boolean batchRetrieved
         vector[board2D] canonicalBoards
@@ -97,6 +157,18 @@ cdef extern from "include/BatchManager.h":
 
         int batchSize, numSims, numThreads
         float cpuct, percent_q
+        float noiseReuseFraction
+        int leavesPerTree
+        float fullSearchProb
+        int fastSims
+        boolean earlyStop
+        float earlyStopKL
+        boolean useUCT
+        uctOptions uct
+        long long workerNodeBudget
+        boolean freezeOnBudget
+        boolean gumbelRoot
+        int gumbelTopK
 
         void createMCTSThreads()
         void stopMCTSThreads()
@@ -107,6 +179,12 @@ cdef extern from "include/BatchManager.h":
         void putBatch(batch evaluation)
 
         int getOngoingGames()
+        boolean workersFinished()
+
+        void resizeCache(int size)
+        void flushCache()
+        nnCacheStats getCacheStats()
+        treeMemoryStats getTreeStats()
 
         vector[trainingExampleVector] getTrainingExamples(int pastIterations)
         vector[trainingExampleVector] getTrainingExamples()
@@ -118,4 +196,25 @@ cdef extern from "include/BatchManager.h":
 
     cdef void saveTrainingDataToFile(string filename)
     cdef void loadTrainingDataFromFile(string filename)
-    
\ No newline at end of file
+    
+
+
+cdef extern from "include/ParallelMCTS.h":
+    cdef int PARALLEL_THREADS_DEFAULT
+    cdef int PARALLEL_MAX_NODES_DEFAULT
+
+    ctypedef void (*positionEvaluator)(void *context, vector[GameState] &positions, vector[vector[float]] &policies, vector[float] &values)
+
+    cdef cppclass ParallelMCTS:
+        ParallelMCTS(int _numThreads, float _cpuct, int maxNodes) except +
+
+        int numThreads, batchSize, solverSpots
+        float cpuct, virtualLoss
+
+        void setEvaluator(positionEvaluator _evaluator, void *context)
+        void search(GameState position, long long maxPlayouts) nogil
+        void stop() nogil
+        long long getPlayouts()
+        vector[float] getActionProb()
+        vector[int] getPV(int maxLength)
+        float getBestValue()
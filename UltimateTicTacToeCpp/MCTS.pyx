@@ -75,8 +75,25 @@ cdef class PyMCTS:
     def getActionProb(self):
         return self.mcts.getActionProb()
 
-    def takeAction(self, int action):
-        self.mcts.takeAction(action)
+    def getBookAction(self):
+        return self.mcts.getBookAction()
+
+    @property
+    def useOpeningBook(self):
+        return self.mcts.useOpeningBook
+
+    @useOpeningBook.setter
+    def useOpeningBook(self, value):
+        self.mcts.useOpeningBook = value
+
+    def takeAction(self, int action, float reuse_fraction=1):
+        self.mcts.takeAction(action, reuse_fraction)
+
+    def saveTree(self, filename, int max_depth=0, unsigned int min_visits=0):
+        return self.mcts.saveTree(filename.encode('UTF-8'), max_depth, min_visits)
+
+    def loadTree(self, filename):
+        return self.mcts.loadTree(filename.encode('UTF-8'))
 
     def getStatus(self):
         return self.mcts.getStatus()
@@ -117,8 +134,28 @@ cdef class PyMCTS:
         return inputs, targetPi, targetV
 
 
-def runSelfPlayEpisodes(evaluate, int batchSize=512, int numThreads=1, int sims=850, int pastIterations=2, float cpuct=1, double dir_a=0.8, double dir_x=0.5, float percent_q=0.5):
+def load_opening_book(filename):
+    """
+    Memory maps the opening book file for the MCTS trees with useOpeningBook
+    set. This module has its own copy of the book, so the book loaded by
+    Minimax.load_opening_book is not seen here.
+    """
+    return loadOpeningBook(filename.encode('UTF-8'))
+
+
+def runSelfPlayEpisodes(evaluate, int batchSize=512, int numThreads=1, int sims=850, int pastIterations=2, float cpuct=1, double dir_a=0.8, double dir_x=0.5, float percent_q=0.5, float noise_reuse=1, int leaves_per_tree=1, int cache_size=NN_CACHE_SIZE_DEFAULT, float full_search_prob=1, int fast_sims=100, early_stop=False, float early_stop_kl=0, long long worker_node_budget=WORKER_NODE_BUDGET_DEFAULT, freeze_on_budget=False, gumbel_root=False, int gumbel_top_k=GUMBEL_TOP_K_DEFAULT):
     cdef BatchManager m = BatchManager(batchSize, numThreads, cpuct, sims, dir_a, dir_x, percent_q)
+    m.noiseReuseFraction = noise_reuse
+    m.leavesPerTree = leaves_per_tree
+    m.resizeCache(cache_size)
+    m.fullSearchProb = full_search_prob
+    m.fastSims = fast_sims
+    m.earlyStop = early_stop
+    m.earlyStopKL = early_stop_kl
+    m.workerNodeBudget = worker_node_budget
+    m.freezeOnBudget = freeze_on_budget
+    m.gumbelRoot = gumbel_root
+    m.gumbelTopK = gumbel_top_k
 
     print("Starting search...")
 
@@ -177,6 +214,44 @@ def runSelfPlayEpisodes(evaluate, int batchSize=512, int numThreads=1, int sims=
 
             # TODO: Convert result back to batch
             m.putBatch(start)
+
+    cdef nnCacheStats cacheStats = m.getCacheStats()
+    print(f"NN cache: {cacheStats.hits} hits / {cacheStats.probes} probes ({100 * cacheStats.hitRate():.1f}%), {cacheStats.evictions} evictions")
+    printTreeStats(m.getTreeStats())
+
+    m.saveTrainingExampleHistory()
+    allTrainingExamples = m.getTrainingExamples(pastIterations)
+
+    return c_compileExamples2D(allTrainingExamples)
+
+
+cdef printTreeStats(treeMemoryStats stats):
+    print(f"MCTS trees: peak {stats.peakTreeBytes / 1e6:.1f} MB per tree, {stats.peakWorkerBytes / 1e6:.1f} MB per worker, {stats.prunes} prunes")
+
+
+def runSelfPlayUCT(int batchSize=64, int numThreads=1, int sims=850, int pastIterations=2, float cpuct=1, double dir_a=0.8, double dir_x=0.5, float percent_q=0.5, int rollouts=ROLLOUTS_PER_LEAF_DEFAULT, heuristic_priors=False, int leaves_per_tree=1, int cache_size=0, long long worker_node_budget=WORKER_NODE_BUDGET_DEFAULT, freeze_on_budget=False):
+    """
+    Plays self-play games with UCT and random rollouts instead of the NN,
+    eg for the first generation of training data. The rollout values are
+    noisy, so the NN cache is off by default.
+    """
+    cdef BatchManager m = BatchManager(batchSize, numThreads, cpuct, sims, dir_a, dir_x, percent_q)
+    m.leavesPerTree = leaves_per_tree
+    m.resizeCache(cache_size)
+    m.useUCT = True
+    m.uct.rolloutsPerLeaf = rollouts
+    m.uct.heuristicPriors = heuristic_priors
+    m.workerNodeBudget = worker_node_budget
+    m.freezeOnBudget = freeze_on_budget
+
+    m.createMCTSThreads()
+
+    # The workers evaluate their own leaves, so there is nothing to do until they finish
+    while not m.workersFinished():
+        time.sleep(0.1)
+
+    printTreeStats(m.getTreeStats())
+
     m.saveTrainingExampleHistory()
     allTrainingExamples = m.getTrainingExamples(pastIterations)
 
@@ -341,3 +416,107 @@ cdef c_compileExamples2D(vector[trainingExampleVector] trainingExamples):
 
         vsView[exIndex] = trainingExamples[exIndex].result
     return boards, pis, vs
+
+
+cdef void pythonBatchEvaluation(void *context, vector[GameState] &positions, vector[vector[float]] &policies, vector[float] &values) noexcept with gil:
+    """
+    Evaluates a batch from ParallelMCTS with the python evaluate function,
+    which takes the canonical boards like runSelfPlayEpisodes.
+
+    Exceptions cannot pass through ParallelMCTS, so an error or a result of
+    the wrong shape leaves the batch empty, which stops the search, and is
+    raised by PyParallelMCTS.search once the search returns.
+    """
+    cdef PyParallelMCTS search = <PyParallelMCTS> context
+
+    cdef int i, j
+    cdef int numPositions = positions.size()
+    cdef board2D canBoard
+    cdef int [:, :, :] boardsView
+
+    policies.clear()
+    values.clear()
+
+    try:
+        boards = np.zeros((numPositions, 99, 2), dtype=np.intc)
+        boardsView = boards
+
+        for i in range(numPositions):
+            canBoard = positions[i].get2DCanonicalBoard()
+            for j in range(99):
+                boardsView[i][j][0] = canBoard.board[j][0]
+                boardsView[i][j][1] = canBoard.board[j][1]
+
+        pi, v = search.evaluate(boards)
+        pi = np.asarray(pi, dtype=np.float32)
+        v = np.asarray(v, dtype=np.float32).reshape(-1)
+
+        if pi.shape != (numPositions, 81) or v.shape != (numPositions,):
+            raise ValueError("evaluate gave pi of shape %s and v of shape %s for %d boards, expected (%d, 81) and (%d,)"
+                             % (pi.shape, v.shape, numPositions, numPositions, numPositions))
+
+        policies.resize(numPositions)
+        values.resize(numPositions)
+
+        for i in range(numPositions):
+            values[i] = v[i]
+            policies[i].resize(81)
+            for j in range(81):
+                policies[i][j] = pi[i][j]
+    except BaseException as error:
+        policies.clear()
+        values.clear()
+
+        if search.evaluatorError is None:
+            search.evaluatorError = error
+
+
+cdef class PyParallelMCTS:
+    """
+    Tree-parallel MCTS for analysing one position with several threads.
+    The leaves of all threads are evaluated together, with evaluate(boards)
+    returning (pi, v) like the function given to runSelfPlayEpisodes. Without
+    an evaluate function the static evaluation is used.
+    """
+    cdef ParallelMCTS *c_search
+    cdef object evaluate
+
+    # The first error from evaluate in the current search
+    cdef object evaluatorError
+
+    def __cinit__(self, int numThreads=PARALLEL_THREADS_DEFAULT, float cpuct=1, int maxNodes=PARALLEL_MAX_NODES_DEFAULT, evaluate=None):
+        self.c_search = new ParallelMCTS(numThreads, cpuct, maxNodes)
+        self.evaluate = evaluate
+
+        if evaluate is not None:
+            self.c_search.setEvaluator(pythonBatchEvaluation, <void *> self)
+
+    def __dealloc__(self):
+        del self.c_search
+
+    def search(self, PyGameState position, long long playouts):
+        self.evaluatorError = None
+
+        with nogil:
+            self.c_search.search(position.c_gamestate, playouts)
+
+        if self.evaluatorError is not None:
+            error = self.evaluatorError
+            self.evaluatorError = None
+            raise error
+
+    def stop(self):
+        with nogil:
+            self.c_search.stop()
+
+    def get_playouts(self):
+        return self.c_search.getPlayouts()
+
+    def getActionProb(self):
+        return self.c_search.getActionProb()
+
+    def get_pv(self, int maxLength=81):
+        return self.c_search.getPV(maxLength)
+
+    def get_best_value(self):
+        return self.c_search.getBestValue()
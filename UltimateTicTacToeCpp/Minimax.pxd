@@ -1,5 +1,6 @@
 from libcpp.vector cimport vector
 from libcpp cimport bool as boolean
+from libcpp.string cimport string
 
 cdef extern from "src/Minimax.cpp":
     pass
@@ -7,6 +8,18 @@ cdef extern from "src/Minimax.cpp":
 cdef extern from "src/GameState.cpp":
     pass
 
+cdef extern from "src/OpeningBook.cpp":
+    pass
+
+cdef extern from "src/ProofNumber.cpp":
+    pass
+
+cdef extern from "src/AsyncSearch.cpp":
+    pass
+
+cdef extern from "src/Labeler.cpp":
+    pass
+
 cdef extern from "include/GameState.h":
     cdef struct boardCoords:
         char board, piece
@@ -55,7 +68,83 @@ cdef extern from "include/Minimax.h":
         boolean hasChildren
 
 
+    cdef struct pvLine:
+        GameState board
+        float eval
+        int mateDistance
+        vector[int] pv
+
+    cdef vector[pvLine] minimaxSearchMultiPV(GameState, int, bool, int)
+
+    cdef struct iterationStats:
+        int depth
+        long long nodes, elapsedUs
+
+    cdef cppclass searchStats:
+        long long nodes, leaves, cutoffs, firstMoveCutoffs
+        long long evalCacheProbes, evalCacheHits
+        long long ttProbes, ttHits, ttStores
+        int depth
+        long long elapsedUs
+        vector[iterationStats] iterations
+
+        double nodesPerSecond()
+        double firstMoveCutoffRate()
+        double evalCacheHitRate()
+        double ttHitRate()
+        double effectiveBranchingFactor()
+
+    cdef searchStats getSearchStats()
+
     cdef boardCoords minimaxSearchMove(GameState, int, bool)
     cdef boardCoords minimaxSearchTimeMove(GameState, int, bool)
 
+cdef extern from "include/ProofNumber.h":
+    cdef cppclass ProofNumberSearch:
+        int solve(GameState position)
+        int solve(GameState position, int &bestAction)
+        int nodesSearched
+
+    cdef ProofNumberSearch& getEndgameSolver()
+    cdef int countRemainingSpots(GameState &position)
+
+cdef extern from "include/OpeningBook.h":
+    cdef boolean loadOpeningBook(string filename)
+
+
+
+cdef extern from "include/AsyncSearch.h":
+    cdef int ASYNC_MAX_DEPTH_DEFAULT
+
+    cdef cppclass searchInfo:
+        int depth, bestAction, mateDistance
+        float eval
+        vector[int] pv
+        long long elapsedMs
+        boolean finished
+        searchStats stats
+
+    cdef cppclass AsyncSearch:
+        AsyncSearch() except +
+        void start(GameState position, int maxDepth) nogil
+        void ponder(GameState position, int expectedAction, int maxDepth) nogil
+        boolean ponderHit(int action) nogil
+        void stop() nogil
+        void wait() nogil
+        boolean isRunning()
+        boolean isPondering()
+        searchInfo poll()
+        GameState getPosition()
+
+cdef extern from "include/Labeler.h":
+    cdef int LABEL_DEPTH_DEFAULT
+    cdef int LABEL_PV_LENGTH
+
+    cdef cppclass labelHeader:
+        pass
+
+    cdef cppclass labelOptions:
+        int depth, timeMs, numThreads
+        boolean resume
 
+    cdef long long labelPositions(vector[GameState] positions, string outputFile, labelOptions options) nogil
@@ -114,6 +114,14 @@ def minimaxSearch(PyGameState position, int depth, evaluate):
     return finalState
 
 
+def load_opening_book(filename):
+    """
+    Memory maps the opening book file so that minimax_search_move and
+    minimax_search_move_time play book moves without searching.
+    """
+    return loadOpeningBook(filename.encode('UTF-8'))
+
+
 def getActionProbabilities(PyGameState position, int depth, evaluate, int temp=1):
     cdef Node start = Node(position.c_gamestate, 0)
 
@@ -188,6 +196,34 @@ def getActionProbabilities(PyGameState position, int depth, evaluate, int temp=1
     return moves
 
 
+cdef object search_stats_to_dict(searchStats stats):
+    return {
+        "depth": stats.depth,
+        "nodes": stats.nodes,
+        "leaves": stats.leaves,
+        "elapsed_us": stats.elapsedUs,
+        "nps": stats.nodesPerSecond(),
+        "cutoffs": stats.cutoffs,
+        "first_move_cutoff_rate": stats.firstMoveCutoffRate(),
+        "eval_cache_probes": stats.evalCacheProbes,
+        "eval_cache_hits": stats.evalCacheHits,
+        "eval_cache_hit_rate": stats.evalCacheHitRate(),
+        "tt_probes": stats.ttProbes,
+        "tt_hits": stats.ttHits,
+        "tt_stores": stats.ttStores,
+        "tt_hit_rate": stats.ttHitRate(),
+        "effective_branching_factor": stats.effectiveBranchingFactor(),
+        "iterations": [{"depth": i.depth, "nodes": i.nodes, "elapsed_us": i.elapsedUs} for i in stats.iterations],
+    }
+
+
+def get_search_stats():
+    """
+    Gets the statistics of the most recent minimax search on this thread.
+    """
+    return search_stats_to_dict(getSearchStats())
+
+
 cdef class PyNode:
     cdef Node c_node
 
@@ -245,6 +281,27 @@ cdef class PyGameState:
 
         return [nextMove.board, nextMove.piece]
 
+    def minimax_search_multipv(self, depth, playAsX, numPV):
+        """
+        Gets the best numPV moves from a single search, best first.
+        Each line is a dict with the move, its score, the principal
+        variation as [board, piece] pairs and the mate distance (-1 if
+        the score is not a forced result).
+        """
+        cdef vector[pvLine] lines = minimaxSearchMultiPV(self.c_gamestate, depth, playAsX, numPV)
+        cdef int i
+
+        result = []
+        for i in range(lines.size()):
+            result.append({
+                "move": [lines[i].board.previousMove.board, lines[i].board.previousMove.piece],
+                "eval": lines[i].eval,
+                "mate_distance": lines[i].mateDistance,
+                "pv": [[action // 9, action % 9] for action in lines[i].pv],
+            })
+
+        return result
+
     def minimax_search_move_time(self, time, playAsX):
         cdef boardCoords nextMove
 
@@ -252,6 +309,20 @@ cdef class PyGameState:
         return [nextMove.board, nextMove.piece]
 
 
+    def solve(self):
+        """
+        Solves the position with the endgame solver.
+        Returns [result, board, piece] where result is 0 if unknown,
+        1 if X wins, 2 if O wins and 3 for a tie.
+        """
+        cdef int bestAction = -1
+        cdef int result = getEndgameSolver().solve(self.c_gamestate, bestAction)
+
+        if bestAction == -1:
+            return [result, -1, -1]
+
+        return [result, bestAction // 9, bestAction % 9]
+
     def get_required_board(self):
         return self.c_gamestate.getRequiredBoard()
 
@@ -260,3 +331,126 @@ cdef class PyGameState:
 
     def is_valid_move(self, board, piece):
         return bool(self.c_gamestate.isValidMove(board, piece))
+
+
+
+cdef class PyAsyncSearch:
+    """
+    Minimax search running on a background thread.
+    Call poll() to read the result of the deepest completed iteration.
+    """
+    cdef AsyncSearch *c_search
+
+    def __cinit__(self):
+        self.c_search = new AsyncSearch()
+
+    def __dealloc__(self):
+        with nogil:
+            self.c_search.stop()
+        del self.c_search
+
+    def start(self, PyGameState game, maxDepth=ASYNC_MAX_DEPTH_DEFAULT):
+        cdef int depth = maxDepth
+        with nogil:
+            self.c_search.start(game.c_gamestate, depth)
+
+    def ponder(self, PyGameState game, expectedBoard, expectedPiece, maxDepth=ASYNC_MAX_DEPTH_DEFAULT):
+        """
+        Searches the position after the opponent's expected move.
+        """
+        cdef int action = expectedBoard * 9 + expectedPiece
+        cdef int depth = maxDepth
+        with nogil:
+            self.c_search.ponder(game.c_gamestate, action, depth)
+
+    def ponder_hit(self, board, piece):
+        """
+        Returns True if the ponder search was kept, otherwise the search
+        has been stopped and start() must be called with the new position.
+        """
+        cdef int action = board * 9 + piece
+        cdef boolean hit
+        with nogil:
+            hit = self.c_search.ponderHit(action)
+        return hit
+
+    def stop(self):
+        with nogil:
+            self.c_search.stop()
+
+    def wait(self):
+        with nogil:
+            self.c_search.wait()
+
+    def is_running(self):
+        return self.c_search.isRunning()
+
+    def is_pondering(self):
+        return self.c_search.isPondering()
+
+    def poll(self):
+        cdef searchInfo info = self.c_search.poll()
+
+        move = None
+        if info.bestAction != -1:
+            move = [info.bestAction // 9, info.bestAction % 9]
+
+        return {
+            "depth": info.depth,
+            "move": move,
+            "eval": info.eval,
+            "mate_distance": info.mateDistance,
+            "pv": [[action // 9, action % 9] for action in info.pv],
+            "elapsed_ms": info.elapsedMs,
+            "finished": info.finished,
+            "stats": search_stats_to_dict(info.stats),
+        }
+
+
+
+# Matches labelRecord in Labeler.h
+label_dtype = np.dtype([
+    ("index", np.uint32),
+    ("board", np.uint32, 9),
+    ("score", np.float32),
+    ("mate_distance", np.int16),
+    ("best_action", np.int8),
+    ("info", np.uint8),
+    ("depth", np.uint8),
+    ("pv_length", np.uint8),
+    ("pv", np.int8, LABEL_PV_LENGTH),
+])
+
+
+def label_positions(positions, output_file, depth=LABEL_DEPTH_DEFAULT, time_ms=0, threads=1, resume=True):
+    """
+    Labels a list of PyGameStates with minimax scores, best moves and
+    principal variations on the given number of threads, appending the
+    records to output_file. If resume is set, positions already in the
+    file are skipped. Returns the number of positions labeled.
+    """
+    cdef vector[GameState] c_positions
+    cdef PyGameState position
+    cdef labelOptions options
+    cdef string filename = output_file.encode('UTF-8')
+    cdef long long labeled
+
+    for position in positions:
+        c_positions.push_back(position.c_gamestate)
+
+    options.depth = depth
+    options.timeMs = time_ms
+    options.numThreads = threads
+    options.resume = resume
+
+    with nogil:
+        labeled = labelPositions(c_positions, filename, options)
+
+    return labeled
+
+
+def load_labels(filename):
+    """
+    Reads a label file into a numpy array with label_dtype.
+    """
+    return np.fromfile(filename, dtype=label_dtype, offset=sizeof(labelHeader))
@@ -0,0 +1,143 @@
+#pragma once
+using namespace std;
+
+#include <GameState.h>
+#include <Minimax.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define ASYNC_MAX_DEPTH_DEFAULT     64
+
+/**
+ * The progress of an asynchronous search.
+ * eval is from the perspective of the player to move in the searched position.
+ */
+struct searchInfo {
+    // Deepest fully searched iteration, 0 if none have finished
+    int depth = 0;
+    int bestAction = -1;
+    float eval = 0;
+    int mateDistance = -1;
+    vector<int> pv;
+
+    long long elapsedMs = 0;
+    bool finished = false;
+
+    searchStats stats;
+};
+
+/**
+ * Limits for an asynchronous search. The search stops at whichever is
+ * reached first; 0 means no limit for nodes and moveTimeMs.
+ */
+struct searchLimits {
+    int maxDepth = ASYNC_MAX_DEPTH_DEFAULT;
+    long long nodes = 0;
+    int moveTimeMs = 0;
+};
+
+// Called from the search thread after every completed iteration
+typedef function<void(searchInfo)> searchCallback;
+
+/**
+ * Runs an iterative deepening minimax search on a background thread.
+ *
+ * Progress can be read with poll() or received through a callback, and
+ * the search can be stopped at any time, keeping the result of the last
+ * completed iteration.
+ *
+ * While pondering, the search runs on the position after the expected
+ * reply. If the opponent plays that reply, ponderHit() turns the ponder
+ * search into the real search without losing any of its work.
+ *
+ * The same thread runs every search, so its evaluation cache and solver
+ * table stay warm from one move to the next.
+ */
+class AsyncSearch {
+    private:
+        thread worker;
+        atomic<bool> stopFlag;
+
+        // Protects the job and the state of the worker
+        mutex jobMtx;
+        condition_variable jobCv;
+        bool hasJob = false, searching = false, quit = false;
+
+        GameState jobPosition;
+        searchLimits jobLimits;
+        constants jobConstants;
+        searchCallback jobCallback;
+
+        mutex infoMtx;
+        searchInfo info;
+
+        bool pondering = false;
+        int ponderAction = -1;
+        int ponderMoveTimeMs = 0;
+        GameState searchPosition;
+
+        // Stops the search when the move time runs out
+        thread timer;
+        mutex timerMtx;
+        condition_variable timerCv;
+        bool timerCancelled = false;
+
+        void startTimer(int moveTimeMs);
+        void cancelTimer();
+
+        void postJob(GameState position, searchLimits limits, constants c, searchCallback callback);
+        void workerLoop();
+        void run(GameState position, searchLimits limits, constants c, searchCallback callback);
+
+    public:
+        AsyncSearch();
+        ~AsyncSearch();
+
+        /**
+         * Starts searching the position, stopping any search already running.
+         *
+         * @param maxDepth The search finishes on its own after this depth
+         * @param callback Optional, may be nullptr
+         */
+        void start(GameState position, searchLimits limits, constants c, searchCallback callback);
+        void start(GameState position, int maxDepth, constants c, searchCallback callback);
+        void start(GameState position, int maxDepth);
+
+        /**
+         * Starts searching the position after expectedAction is played
+         * in the given position. The move time only starts counting after
+         * a ponder hit.
+         */
+        void ponder(GameState position, int expectedAction, searchLimits limits, constants c, searchCallback callback);
+        void ponder(GameState position, int expectedAction, int maxDepth, constants c, searchCallback callback);
+        void ponder(GameState position, int expectedAction, int maxDepth);
+
+        /**
+         * Tells the search which action the opponent played.
+         *
+         * @return true if the ponder search was for that action and has been
+         *         kept, false if it was stopped and a new search must be started
+         */
+        bool ponderHit(int action);
+
+        /**
+         * Stops the search and waits for it to finish.
+         */
+        void stop();
+
+        /**
+         * Waits for the search to finish on its own.
+         */
+        void wait();
+
+        bool isRunning();
+        bool isPondering();
+
+        searchInfo poll();
+
+        GameState getPosition();
+};
@@ -5,6 +5,8 @@ using namespace std;
 #include <thread>
 #include <mutex>
 #include <MonteCarlo.h>
+#include <NNCache.h>
+#include <Rollout.h>
 #include <random>
 #include <fstream>
 
@@ -17,6 +19,15 @@ using namespace std;
 #define DIRICHLET_DEFAULT_X         0.5
 #define PERCENT_Q_IN_TRAINING       0.5
 #define TEMP_THRESHOLD              25
+#define NOISE_REUSE_DEFAULT         1
+#define LEAVES_PER_TREE_DEFAULT     1
+#define FULL_SEARCH_PROB_DEFAULT    1       // Playout cap randomization, 1 gives every move a full search
+#define FAST_SIMS_DEFAULT           100
+#define EARLY_STOP_DEFAULT          false
+#define EARLY_STOP_KL_DEFAULT       0       // 0 disables the convergence check
+#define KL_CHECK_INTERVAL           50      // Sims between convergence checks
+#define CACHE_RETRIES               8       // Selections per round while every leaf is found in the NN cache
+#define WORKER_NODE_BUDGET_DEFAULT  0       // 0 for no limit
 
 
 struct batch {
@@ -27,6 +38,15 @@ struct batch {
     vector<vector<float>> pis;
 };
 
+/**
+ * Memory of the MCTS trees of the worker threads since the threads started.
+ */
+struct treeMemoryStats {
+    long long peakTreeBytes = 0;
+    long long peakWorkerBytes = 0;
+    long long prunes = 0;
+};
+
 class BatchManager {
 private:
 
@@ -45,6 +65,54 @@ public:
     // Higher values favor the original value more
     double dirichlet_x = DIRICHLET_DEFAULT_X;
 
+    // Fraction of the reused subtree visits kept after a move picked with noise
+    float noiseReuseFraction = NOISE_REUSE_DEFAULT;
+
+    // Leaves each game selects per NN batch, using virtual loss when above 1
+    int leavesPerTree = LEAVES_PER_TREE_DEFAULT;
+
+    /**
+     * Each move gets a full search of numSims with probability fullSearchProb,
+     * otherwise a fast search of fastSims. Only fully searched positions are
+     * saved for training, and fast searches play without noise.
+     */
+    float fullSearchProb = FULL_SEARCH_PROB_DEFAULT;
+    int fastSims = FAST_SIMS_DEFAULT;
+
+    /**
+     * A game stops searching its move early, leaving the NN to the other
+     * games, once earlyStop is set and the remaining sims can not change
+     * the move played without noise, or once the root visit distribution
+     * moves less than earlyStopKL (KL divergence) in KL_CHECK_INTERVAL sims.
+     */
+    bool earlyStop = EARLY_STOP_DEFAULT;
+    float earlyStopKL = EARLY_STOP_KL_DEFAULT;
+
+    /**
+     * Plays the games with UCT instead of the NN, scoring the leaves in the
+     * worker threads with uctEvaluation, eg to make the first generation of
+     * training data. No batches are posted for evaluation.
+     */
+    bool useUCT = false;
+    uctOptions uct;
+
+    /**
+     * Nodes and edges each worker thread's trees may hold together, split
+     * evenly between its games, 0 for no limit. See MCTS::nodeBudget for
+     * how a tree is kept inside its share.
+     */
+    long long workerNodeBudget = WORKER_NODE_BUDGET_DEFAULT;
+    bool freezeOnBudget = false;
+
+    /**
+     * Searches each root with Gumbel top-k sampling and sequential halving,
+     * see MCTS::gumbelRoot. The Gumbel noise replaces the Dirichlet noise,
+     * the improved policy is saved as the training target and the early
+     * stop checks are skipped, since halving decides the move by design.
+     */
+    bool gumbelRoot = false;
+    int gumbelTopK = GUMBEL_TOP_K_DEFAULT;
+
 
     /**
      * Starts the given number MCTS worker threads.
@@ -75,6 +143,24 @@ public:
 
     int getOngoingGames();
 
+    /**
+     * Checks if every worker thread started by createMCTSThreads has
+     * finished its games. Unlike getOngoingGames, this cannot be mistaken
+     * for games that have not started yet.
+     */
+    bool workersFinished();
+
+    /**
+     * The NN evaluations are cached and shared by all of the worker
+     * threads. A size of 0 disables the cache. The cache must be flushed
+     * whenever the network changes.
+     */
+    void resizeCache(int size);
+    void flushCache();
+    nnCacheStats getCacheStats();
+
+    treeMemoryStats getTreeStats();
+
     /**
      * Compile the training data from the given number of iterations.
      * Data will be combined with equal weight, and all duplicates will be combined.
@@ -107,6 +193,12 @@ int RandomActionWeighted(vector<float> weights);
 
 int MaxAction(vector<float> weights);
 
+/**
+ * Maps the policy of a position to a symmetric position. The symmetries
+ * are the ones that turn each position into its canonical orientation.
+ */
+vector<float> mapPolicySymmetry(vector<float> &policy, int fromSymmetry, int toSymmetry);
+
 /**
  * Add the newEx into the running average for Pi and Result for exisiting.
  */
@@ -27,6 +27,15 @@ const bitset<20> winningPosO[] = {
     0b00001000100010000000,
 };
 
+/**
+ * Maps each spot of a 3x3 board to the spot it is taken from
+ * under each of the 8 symmetries. The same mapping is used for
+ * the miniboards within the full board.
+ *
+ * Auto-generated using createGetSymmetries.py
+ */
+extern int symmetriesMappingSingleBoard[8][9];
+
 struct boardCoords {
     int board, piece;
 };
@@ -84,6 +93,14 @@ class GameState {
 
     vector<GameState> allPossibleMoves();
 
+    /**
+     * Gets the actions (board * 9 + piece) of all possible moves, in
+     * the same order as allPossibleMoves.
+     *
+     * @return The number of actions
+     */
+    int getValidActions(unsigned char actions[81]);
+
     boardCoords absoluteIndexToBoardAndPiece(int i);
 
     void displayGame();
@@ -142,7 +159,50 @@ class GameState {
     board2D get2DCanonicalBoard();
 
     bitset<199> getCanonicalBoardBitset();
+
+    /**
+     * Gets a 64-bit hash of the position. Two positions with
+     * the same pieces, player to move and required board
+     * always have the same hash.
+     */
+    unsigned long long hash();
+
+    /**
+     * Gets the position transformed by one of the 8 symmetries
+     * in symmetriesMappingSingleBoard.
+     */
+    GameState getSymmetry(int symmetry);
+
+    /**
+     * Gets the symmetry that transforms this position into its
+     * canonical orientation, ie the orientation with the lowest hash.
+     */
+    int getCanonicalSymmetry();
+
+    /**
+     * Gets the hash of the canonical orientation of the position.
+     * All 8 symmetric positions share the same canonical hash.
+     */
+    unsigned long long canonicalHash();
+
+    /**
+     * Gets the canonical hash and the symmetry that gives it together, so
+     * every key built from the canonical orientation picks it the same way.
+     */
+    unsigned long long canonicalHash(int &symmetry);
     
 };
 
 GameState boardVector2GameState(vector<int> board);
+
+/**
+ * Converts an action (board * 9 + piece) on a position to the
+ * matching action on the position transformed by getSymmetry(symmetry).
+ */
+int actionToSymmetry(int action, int symmetry);
+
+/**
+ * Converts an action on a position transformed by getSymmetry(symmetry)
+ * back to the matching action on the original position.
+ */
+int actionFromSymmetry(int action, int symmetry);
@@ -0,0 +1,97 @@
+#pragma once
+using namespace std;
+
+#include <GameState.h>
+#include <Minimax.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define LABEL_MAGIC                 0x4C42414C  // "LABL"
+#define LABEL_VERSION               1
+
+#define LABEL_DEPTH_DEFAULT         8
+#define LABEL_MAX_DEPTH             64
+#define LABEL_PV_LENGTH             14
+
+// Records are written to disk after this many positions, so at most this many are redone after an interruption
+#define LABEL_FLUSH_INTERVAL        64
+#define LABEL_REPORT_INTERVAL       1000
+
+struct labelHeader {
+    unsigned int magic = LABEL_MAGIC;
+    unsigned int version = LABEL_VERSION;
+    unsigned int recordSize = 0;
+    unsigned int reserved = 0;
+};
+
+/**
+ * A labeled position. Records are 64 bytes with no padding, so a label
+ * file is the header followed by an array that can be read directly
+ * with numpy.
+ *
+ * index is the position's index in the input, eg its line in the positions
+ * file, so it stays the same when other lines are skipped. board and info are the
+ * GameState members of the same name, and score is from the perspective
+ * of the player to move. mateDistance is -1 unless the score is a forced
+ * result. Actions are board * 9 + piece, and unused pv entries are -1.
+ */
+struct labelRecord {
+    unsigned int index;
+    unsigned int board[9];
+    float score;
+    short mateDistance;
+    int8_t bestAction;
+    unsigned char info;
+    unsigned char depth;
+    unsigned char pvLength;
+    int8_t pv[LABEL_PV_LENGTH];
+};
+
+struct labelOptions {
+    // Fixed depth search, used if timeMs is 0
+    int depth = LABEL_DEPTH_DEFAULT;
+
+    /**
+     * If set, each position is searched with iterative deepening and no
+     * new iteration is started once the next one is expected to finish
+     * after this many milliseconds.
+     */
+    int timeMs = 0;
+
+    int numThreads = 1;
+    constants c;
+
+    // Keep the records already in the output file and skip their positions
+    bool resume = true;
+
+    int reportInterval = LABEL_REPORT_INTERVAL;
+};
+
+/**
+ * Labels a single position with its score, best move and principal variation.
+ */
+labelRecord labelPosition(GameState position, unsigned int index, labelOptions options);
+
+/**
+ * Labels positions on a pool of threads and appends the records to
+ * outputFile in the order they finish.
+ *
+ * @return The number of positions labeled by this call, or -1 if the
+ *         output file could not be used
+ */
+long long labelPositions(vector<GameState> positions, string outputFile, labelOptions options);
+
+/**
+ * labelPositions with the index to record for each position, in
+ * increasing order, eg the line numbers from loadOpenings. Resuming
+ * matches records to positions by these indices.
+ */
+long long labelPositions(vector<GameState> positions, vector<unsigned int> indices, string outputFile, labelOptions options);
+
+/**
+ * Reads every complete record in a label file.
+ */
+vector<labelRecord> loadLabels(string filename);
+
+GameState labelRecordToGameState(labelRecord record);
@@ -0,0 +1,91 @@
+#pragma once
+using namespace std;
+
+#include <GameState.h>
+#include <Minimax.h>
+#include <string>
+#include <vector>
+
+#define MATCH_GAMES_DEFAULT         10000
+#define MATCH_OPENINGS_DEFAULT      500
+#define MATCH_OPENING_PLIES         4
+#define MATCH_REPORT_INTERVAL       100
+
+#define SPRT_ELO0_DEFAULT           0
+#define SPRT_ELO1_DEFAULT           10
+#define SPRT_ALPHA_DEFAULT          0.05
+#define SPRT_BETA_DEFAULT           0.05
+
+/**
+ * A minimax engine taking part in a match.
+ */
+struct engineConfig {
+    int depth = 6;
+    constants c;
+};
+
+struct matchOptions {
+    int maxGames = MATCH_GAMES_DEFAULT;
+    int numThreads = 1;
+
+    // Sequential probability ratio test of H0: elo = elo0 against H1: elo = elo1
+    double elo0 = SPRT_ELO0_DEFAULT, elo1 = SPRT_ELO1_DEFAULT;
+    double alpha = SPRT_ALPHA_DEFAULT, beta = SPRT_BETA_DEFAULT;
+
+    // Print the standings after this many games
+    int reportInterval = MATCH_REPORT_INTERVAL;
+};
+
+/**
+ * Results from the point of view of the first engine.
+ */
+struct matchResults {
+    int wins = 0, losses = 0, draws = 0;
+
+    // 1 if H1 was accepted, -1 if H0 was accepted, 0 if the test did not finish
+    int sprtResult = 0;
+};
+
+/**
+ * Plays a single game between two minimax engines from the given position.
+ *
+ * @return The final status of the game (1: X wins, 2: O wins, 3: Tie)
+ */
+int playGame(GameState position, engineConfig x, engineConfig o);
+
+/**
+ * Generates distinct openings by playing random moves from the start
+ * position. Symmetric duplicates are removed.
+ */
+vector<GameState> generateOpenings(int count, int plies, unsigned int seed);
+
+/**
+ * Loads openings from a file with one opening per line. Each opening is
+ * a list of actions (board * 9 + piece) separated by spaces.
+ */
+vector<GameState> loadOpenings(string filename);
+
+/**
+ * loadOpenings that also gives the line of each opening in the file,
+ * counted from 0. Invalid, empty and finished lines are skipped, so the
+ * line numbers keep an opening's place in the file.
+ */
+vector<GameState> loadOpenings(string filename, vector<unsigned int> &lineNumbers);
+
+/**
+ * Plays engine a against engine b on a pool of threads. Every opening is
+ * played twice, once with each engine as X. Stops when maxGames have been
+ * played or the SPRT accepts either hypothesis.
+ */
+matchResults runMatch(engineConfig a, engineConfig b, vector<GameState> openings, matchOptions options);
+
+/**
+ * Gets the elo difference and its 95% error margin from the results.
+ */
+double eloEstimate(matchResults results);
+double eloErrorMargin(matchResults results);
+
+/**
+ * Gets the log-likelihood ratio of the SPRT for the results.
+ */
+double sprtLLR(matchResults results, double elo0, double elo1);
@@ -2,21 +2,101 @@
 using namespace std;
 
 #include <GameState.h>
+#include <ProofNumber.h>
 #include <bitset>
 #include <vector>
 #include <iostream>
 #include <unordered_map>
+#include <atomic>
 
 const int c1 = 2, c2 = 1, cw = 10, cl = 0, ct = 0;
 
 struct constants {
     int c1 = 2, c2 = 1, cw = 10, cl = 0, ct = 0;
+
+    bool operator==(const constants &other) const {
+        return c1 == other.c1 && c2 == other.c2 && cw == other.cw && cl == other.cl && ct == other.ct;
+    }
 };
 
 struct dualEvals {
     float x, o;
 };
 
+/**
+ * Root positions and leaves of the minimax search with this many empty
+ * playable spots or fewer are solved exactly by the endgame solver.
+ * 0 disables the solver.
+ */
+extern int minimaxSolverSpots, minimaxLeafSolverSpots;
+
+// If set, the root searches print when a forced win or loss is found
+extern bool minimaxVerbose;
+
+/**
+ * If set, searches on this thread return incomplete results as soon as
+ * the flag becomes true.
+ */
+extern thread_local atomic<bool> *minimaxStop;
+
+// Searches on this thread stop once minimaxStats.nodes reaches this, 0 for no limit
+extern thread_local long long minimaxNodeLimit;
+
+struct iterationStats {
+    int depth = 0;
+    long long nodes = 0;
+    long long elapsedUs = 0;
+};
+
+/**
+ * Statistics for a single root search.
+ * Transposition table counts are for the endgame solver's table.
+ */
+struct searchStats {
+    long long nodes = 0, leaves = 0;
+
+    // Cutoffs caused by the first child searched, a measure of move ordering
+    long long cutoffs = 0, firstMoveCutoffs = 0;
+
+    long long evalCacheProbes = 0, evalCacheHits = 0;
+    long long ttProbes = 0, ttHits = 0, ttStores = 0;
+
+    // Deepest completed iteration
+    int depth = 0;
+    long long elapsedUs = 0;
+
+    // Completed iterations of the search; nodes are for that iteration only
+    vector<iterationStats> iterations;
+
+    double nodesPerSecond();
+    double firstMoveCutoffRate();
+    double evalCacheHitRate();
+    double ttHitRate();
+
+    /**
+     * The ratio of nodes between the last two iterations, or
+     * nodes ^ (1 / depth) for a search with a single iteration.
+     */
+    double effectiveBranchingFactor();
+};
+
+/**
+ * The statistics of the most recent root search on this thread.
+ * Counting is always on; it costs a few increments per node.
+ */
+extern thread_local searchStats minimaxStats;
+
+searchStats getSearchStats();
+void printSearchStats(searchStats stats);
+
+/**
+ * Used by the root searches to reset the statistics, record a completed
+ * iteration and record the final time and table counts.
+ */
+void beginSearchStats();
+void endSearchIteration(int depth);
+void endSearchStats();
+
 float evaluate(GameState board, constants c);
 
 float miniboardEvalOneSide(bitset<20> miniboard, int side, constants c);
@@ -103,14 +183,47 @@ struct timeLimitedSearchResult {
     float result;
 };
 
+/**
+ * The result of a search from the root position.
+ * eval is from the perspective of the searching player, and infDepth
+ * is the depth of the forced result if eval is infinite.
+ */
+struct searchResult {
+    GameState board;
+    float eval = 0;
+    int infDepth = -1;
+};
 
 
+
+/**
+ * One line of a multi-PV search.
+ * eval is from the perspective of the searching player, mateDistance is
+ * the number of plies to the forced result if eval is infinite, and pv
+ * holds the actions (board * 9 + piece) starting with the root move.
+ */
+struct pvLine {
+    GameState board;
+    float eval = 0;
+    int mateDistance = -1;
+    vector<int> pv;
+};
+
+bool comparePVLine(pvLine a, pvLine b);
+
 float minimax(Node (&node), int depth, float alpha, float beta, bool maximizingPlayer, constants c);
 timeLimitedSearchResult minimaxTimeLimited(Node (&node), int depth, float alpha, float beta, bool maximizingPlayer, int time, constants c);
+timeLimitedSearchResult minimaxTimeLimited(Node (&node), int depth, float alpha, float beta, bool maximizingPlayer, int time, constants c, vector<int> *pv);
 
 GameState minimaxSearch(GameState position, int depth, bool playAsX);
 GameState minimaxSearch(GameState position, int depth, bool playAsX, constants c);
 
+/**
+ * Searches the position without consulting the opening book and returns
+ * the evaluation of the best move along with the resulting board.
+ */
+searchResult minimaxSearchResult(GameState position, int depth, bool playAsX, constants c);
+
 boardCoords minimaxSearchMove(GameState position, int depth, bool playAsX);
 boardCoords minimaxSearchMove(GameState position, int depth, bool playAsX, constants c);
 
@@ -120,4 +233,12 @@ GameState minimaxSearchTime(GameState position, int time, bool playAsX, constant
 boardCoords minimaxSearchTimeMove(GameState position, int time, bool playAsX);
 boardCoords minimaxSearchTimeMove(GameState position, int time, bool playAsX, constants c);
 
+/**
+ * Gets the best numPV root moves from a single search, best first. Each
+ * line has an exact score and principal variation. No lines are returned
+ * if numPV is less than 1.
+ */
+vector<pvLine> minimaxSearchMultiPV(GameState position, int depth, bool playAsX, int numPV);
+vector<pvLine> minimaxSearchMultiPV(GameState position, int depth, bool playAsX, int numPV, constants c);
+
 int computerVcomputer(int depth1, constants c1, int depth2, constants c2, bool displayGames);
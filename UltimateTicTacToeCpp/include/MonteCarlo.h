@@ -6,9 +6,45 @@ using namespace std;
 #include <iostream>
 #include <GameState.h>
 #include <Minimax.h>
+#include <OpeningBook.h>
+#include <ProofNumber.h>
 #include <limits>
 #include <dirichlet.h>
 
+#define STATIC_EVAL_SCALE           20
+
+// Fraction of the visits of the chosen subtree that takeAction keeps
+#define REUSE_FRACTION_DEFAULT      1
+
+// Value taken off each node on the path to a leaf waiting for the NN
+#define VIRTUAL_LOSS_DEFAULT        1
+
+#define KL_EPSILON                  1e-6f
+
+// Nodes and edges a tree may hold together, 0 for no limit
+#define NODE_BUDGET_DEFAULT         0
+
+// Fraction of the budget a pruned tree is cut down to
+#define PRUNE_TARGET_FRACTION       0.5
+
+// Most nodes and edges a single selection can add: the leaf and its edges
+#define EXPANSION_SIZE              82
+
+// Gumbel root search, the constants are from Gumbel AlphaZero
+#define GUMBEL_TOP_K_DEFAULT        16      // Root actions sampled for sequential halving
+#define GUMBEL_C_VISIT              50
+#define GUMBEL_C_SCALE              1
+
+// MCTS::search grows its batches while they make each leaf this much faster
+#define SEARCH_MAX_LEAVES           64
+#define SEARCH_SAMPLES_PER_SIZE     4       // Batches timed before the batch size changes
+#define SEARCH_MIN_SPEEDUP          0.9
+#define SEARCH_MAX_BATCH_FRACTION   0.1     // Longest batch as a fraction of the time limit
+#define SEARCH_PV_LENGTH            8
+
+#define TREE_SNAPSHOT_MAGIC         0x45455254  // "TREE"
+#define TREE_SNAPSHOT_VERSION       1
+
 
 struct trainingExample {
     bitset<199> canonicalBoard;
@@ -33,8 +69,205 @@ struct trainingExample2D {
     int timesSeen = 1;
 };
 
-random_device rd;
+extern random_device rd;
+
+
+#define NO_NODE                     0xFFFFFFFF
+
+// Proven results, for the player who moved into the node
+#define PROVEN_NONE                 0
+#define PROVEN_WIN                  1
+#define PROVEN_LOSS                 2
+#define PROVEN_DRAW                 3
+
+/**
+ * A node of the MCTS tree. The edges of a node are stored next to each
+ * other in the tree's edge arena, so a node only needs the index of its
+ * first edge. Positions are not stored; they are rebuilt from the actions
+ * on the path from the root as the tree is searched.
+ *
+ * The visits, value and proven result of a node are kept on the edge that
+ * leads to it, so selection finds the statistics of every child together.
+ */
+struct MCTSNode {
+    unsigned int parent = NO_NODE;
+
+    // The edge leading to this node, the root has an edge of its own
+    unsigned int edge = NO_NODE;
+    unsigned int firstEdge = NO_NODE;
+
+    // The action (board * 9 + piece) that leads to this node
+    unsigned char action = 0;
+    unsigned char numEdges = 0;
+    bool hasChildren = false;
+
+    // Set while the node is waiting for a NN evaluation
+    bool pending = false;
+};
+
+// A leaf selected by searchPreNN that is waiting for a NN evaluation
+struct pendingLeaf {
+    unsigned int node;
+    GameState position;
+};
+
+/**
+ * Bump allocator for the nodes or edges of a single tree. Elements are
+ * referred to by index, so the arena can grow and be copied with the tree.
+ * Freeing the tree resets the arena and keeps its memory for the next search.
+ */
+template <typename T>
+class Arena {
+    private:
+        vector<T> nodes;
+
+    public:
+        /**
+         * Allocates count elements next to each other.
+         *
+         * @return The index of the first element
+         */
+        unsigned int allocate(int count) {
+            unsigned int first = nodes.size();
+            nodes.resize(first + count);
+            return first;
+        }
+
+        void reset() {
+            nodes.clear();
+        }
+
+        // Frees the memory kept after a reset
+        void release() {
+            vector<T>().swap(nodes);
+        }
+
+        void swap(Arena<T> &other) {
+            nodes.swap(other.nodes);
+        }
+
+        // Replaces the elements with a copy of count elements from data
+        void assign(const T *data, size_t count) {
+            nodes.assign(data, data + count);
+        }
+
+        T &operator[](unsigned int index) {
+            return nodes[index];
+        }
+
+        size_t size() {
+            return nodes.size();
+        }
+
+        // Bytes held by the arena, including space kept after a reset
+        size_t memoryUsage() {
+            return nodes.capacity() * sizeof(T);
+        }
+};
+
+/**
+ * The edges of a tree stored as one array per field. An edge is a move out
+ * of an expanded node, and holds the statistics of the child it leads to.
+ * The child node is only created the first time the edge is selected.
+ *
+ * Selection reads the prior, visits, value sum and proven result of all of
+ * a node's edges, which are next to each other in each array.
+ */
+class EdgeArena {
+    public:
+        vector<unsigned int> child;
+        vector<unsigned int> n;
+        vector<float> w;
+        vector<float> p;
+
+        // Known result of the child, proven children are not searched again
+        vector<unsigned char> proven;
+
+        // The action (board * 9 + piece) of the edge
+        vector<unsigned char> action;
+
+        /**
+         * Allocates count edges next to each other, with no child or visits.
+         *
+         * @return The index of the first edge
+         */
+        unsigned int allocate(int count);
+
+        void reset();
+        void release();
+        void swap(EdgeArena &other);
+
+        // Copies an edge of another arena into this one
+        void copy(unsigned int index, EdgeArena &from, unsigned int fromIndex);
+
+        size_t size();
+        size_t memoryUsage();
+};
+
+/**
+ * Gets the edge with the highest PUCT score w / n + scale * p / (1 + n),
+ * where scale is cpuct * sqrt(parent visits). An edge with no visits is
+ * picked before any other, and proven edges are skipped. Uses AVX2 when
+ * it is enabled at compile time.
+ *
+ * @return The offset of the edge from first, or -1 if every edge is proven
+ */
+int selectPUCT(EdgeArena &edges, unsigned int first, int count, float scale);
+
+/**
+ * Evaluates a batch of positions without the NN, filling a policy over the
+ * 81 actions and a value for each, in the same form as MCTS::searchPostNN.
+ */
+typedef void (*positionEvaluator)(void *context, vector<GameState> &positions, vector<vector<float>> &policies, vector<float> &values);
+
+// Limits of MCTS::search, 0 for no limit. At least one must be set.
+struct mctsSearchLimits {
+    long long sims = 0;
+    int timeMs = 0;
+};
+
+struct mctsSearchResult {
+    // The action to play, -1 if the root has no moves
+    int action = -1;
+
+    // Mean value of the action for the player to move, from -1 to 1
+    float value = 0;
+
+    // Sims run by this search, and the root visits including the reused ones
+    long long sims = 0;
+    unsigned int rootVisits = 0;
+
+    long long elapsedUs = 0;
+
+    // Batches evaluated, their mean time and the leaves per batch the search settled on
+    int batches = 0;
+    float batchUs = 0;
+    int leavesPerBatch = 1;
+
+    // Root visit distribution and the expected line of play
+    vector<float> policy;
+    vector<int> pv;
+};
+
+/**
+ * A saved MCTS tree is stored as this header, the nodes in breadth first
+ * order with the root first, then each edge array in the order of
+ * EdgeArena's fields. The file can be memory mapped and copied straight
+ * into the arenas without any parse step.
+ *
+ * Positions are rebuilt from the actions on the path from the root, so
+ * only the root position is stored, packed as its miniboards and info.
+ */
+struct treeSnapshotHeader {
+    unsigned int magic = TREE_SNAPSHOT_MAGIC;
+    unsigned int version = TREE_SNAPSHOT_VERSION;
+    unsigned int numNodes = 0;
+    unsigned int numEdges = 0;
 
+    unsigned int rootBoards[9];
+    int rootInfo;
+    int previousBoard, previousPiece;
+};
 
 class MCTS {
     float cpuct = 1;
@@ -46,27 +279,294 @@ class MCTS {
     mt19937 gen;
     dirichlet_distribution<mt19937> dirichlet;
 
+    /**
+     * Adds an edge for every possible move from the position to the node.
+     * Edges are only ever added once.
+     */
+    void addChildren(unsigned int node, GameState &position);
+
+    /**
+     * Gets the child at the end of the edge, creating it if it has not
+     * been selected before.
+     */
+    unsigned int getChild(unsigned int node, unsigned int edge);
+
+    /**
+     * Marks the node with the result of its position, a game status, then
+     * proves its ancestors whose result now follows from their children.
+     */
+    void proveNode(unsigned int node, int status, int toMove);
+
+    /**
+     * Gets the result of an expanded node from the proven results of its
+     * children, PROVEN_NONE if it is not known yet.
+     */
+    unsigned char getProvenResult(unsigned int node);
+
+    /**
+     * Adds value to w of every node from the node up to the root.
+     */
+    void addVirtualLoss(unsigned int node, float value);
+
+    // Set when the last selection reached a leaf that is already pending
+    bool collided = false;
+
+    // The subtree kept by takeAction is copied here, then swapped with the tree
+    Arena<MCTSNode> spareTree;
+    EdgeArena spareEdges;
+
+    /**
+     * Frees the tree and creates a new root with its own edge.
+     */
+    void resetTree();
+
+    /**
+     * Copies the subtree under the node into the spare arenas, packed
+     * breadth first. Children with fewer than minVisits visits or more
+     * than maxDepth moves below the node are not copied; their edges keep
+     * the statistics, so they are searched again as leaves.
+     *
+     * @param node The new root, which keeps a copy of its edge
+     * @param reuseFraction The fraction of the visits of each edge to keep
+     * @param maxDepth 0 for no limit
+     */
+    void copyTree(unsigned int node, float reuseFraction, unsigned int minVisits, int maxDepth);
+
+    /**
+     * Copies the subtree under the node with copyTree, then swaps the
+     * spare arenas with the tree.
+     */
+    void compactTree(unsigned int node, float reuseFraction, unsigned int minVisits);
+
+    /**
+     * Prunes the tree if the next numLeaves selections could take it over
+     * nodeBudget. Nothing can be waiting for the NN.
+     */
+    void enforceNodeBudget(int numLeaves);
+
+    // Gumbel noise of each root edge, the root edges still in the sequential
+    // halving as offsets from the first, and the visits each of them gets by
+    // the end of the phase
+    vector<float> gumbelNoise;
+    vector<unsigned int> gumbelCandidates;
+    unsigned int gumbelTarget;
+
+    // Sims of the Gumbel search, counted from the root visits it started with
+    int gumbelSims = 0;
+    unsigned int gumbelStartVisits;
+
+    // The priors of the root are 0 until it is evaluated
+    bool rootHasPriors();
+
+    /**
+     * Picks the root edge for the next sim of the Gumbel search: the
+     * candidate with the fewest visits that is short of the phase target.
+     * Once every candidate reaches the target, the worse half is dropped.
+     */
+    unsigned int selectGumbelEdge();
+
+    // Mean value of the root edge for the player to move, completed with
+    // the mixed value estimate if the edge has no visits
+    float getCompletedQ(unsigned int edge, float mixedValue);
+    float getMixedValue();
+
+    // Score g + logit + sigma(q) that ranks the Gumbel candidates
+    float getGumbelScore(unsigned int edge, bool withNoise, float mixedValue);
+
     public:
-    Node rootNode;
-    Node *currentNode;
+        Arena<MCTSNode> tree;
+        EdgeArena edges;
+        unsigned int rootIndex;
+        GameState rootPosition;
 
+        // The leaf reached by the last call to searchPreNN, and its position
+        unsigned int currentNode;
+        GameState currentPosition;
 
         MCTS();
         MCTS(float _cupct, double _dirichlet, float _percent_q);
 
         bool gameOver = false;
 
+        // Leaves with this many empty playable spots or fewer are solved instead of evaluated by the NN
+        int solverSpots = SOLVER_SPOTS_DEFAULT;
+
+        // If set, getActionProb plays book moves from openingBook when the root is in the book
+        bool useOpeningBook = false;
+
+        float virtualLoss = VIRTUAL_LOSS_DEFAULT;
+
+        /**
+         * Nodes and edges the tree may hold together, 0 for no limit. When
+         * the budget would be passed, the least visited subtrees are pruned
+         * down to PRUNE_TARGET_FRACTION of the budget. With freezeOnBudget,
+         * leaves stop being expanded instead and are only evaluated, so the
+         * tree keeps every statistic it has.
+         */
+        unsigned int nodeBudget = NODE_BUDGET_DEFAULT;
+        bool freezeOnBudget = false;
+
+        // Number of times the tree was pruned to fit the budget
+        int prunes = 0;
+
+        /**
+         * Searches the root with Gumbel top-k sampling and sequential halving
+         * instead of PUCT, which gives good policy targets with few sims.
+         * startGumbelSearch must be called before each move's search.
+         */
+        bool gumbelRoot = false;
+        int gumbelTopK = GUMBEL_TOP_K_DEFAULT;
+
+        // The leaves selected by the last call to searchPreNN(numLeaves), in order
+        vector<pendingLeaf> pendingLeaves;
+
 
         void startNewSearch(GameState position);
 
-        void backpropagate(Node *finalNode, float result);
+        void backpropagate(unsigned int finalNode, float result);
 
         board2D searchPreNN();
         void searchPostNN(vector<float> policy, float v);
 
+        /**
+         * Selects up to numLeaves different leaves for evaluation. Each
+         * selected leaf gets a virtual loss along its path, so the next
+         * selection is steered elsewhere. Selection stops early if it
+         * reaches a leaf that was already selected.
+         *
+         * @return The boards of the leaves in pendingLeaves
+         */
+        vector<board2D> searchPreNN(int numLeaves);
+
+        /**
+         * Backs up the evaluations of the leaves from searchPreNN(numLeaves),
+         * in the same order, removing their virtual losses.
+         */
+        void searchPostNN(vector<vector<float>> policies, vector<float> values);
+
         bool evaluationNeeded;
 
+        /**
+         * Runs playouts without the NN, scoring each leaf with the evaluator
+         * as soon as it is reached, eg for UCT with random rollouts.
+         */
+        void runPlayouts(int playouts, positionEvaluator evaluator, void *context);
+
+        /**
+         * Searches the root until a limit is reached, evaluating the leaves
+         * in batches. A batch that is expected to end after the time limit
+         * is not started, so the search returns in time as long as the
+         * evaluator's latency is steady.
+         *
+         * The batch size starts at one leaf and doubles while the time per
+         * leaf keeps falling, eg when the evaluator has a fixed cost per
+         * call, up to SEARCH_MAX_LEAVES or SEARCH_MAX_BATCH_FRACTION of the
+         * time limit. With gumbelRoot and a sim limit, the root is searched
+         * with sequential halving.
+         */
+        mctsSearchResult search(mctsSearchLimits limits, positionEvaluator evaluator, void *context);
+
+        MCTSNode &getRoot();
+
+        // Visits of the child at the end of the edge, 0 if it was never selected
+        unsigned int getEdgeVisits(unsigned int edge);
+
+        // Visits and summed value of a node, for the player who moved into it
+        unsigned int getVisits(unsigned int node);
+        float getValueSum(unsigned int node);
+        unsigned char getProven(unsigned int node);
+
+        /**
+         * Gets the edge of the node to play: a proven win if there is one,
+         * otherwise the most visited edge that is not a proven loss.
+         *
+         * @return The edge index, or NO_NODE if the node has no edges
+         */
+        unsigned int getBestEdge(unsigned int node);
+
+        /**
+         * Checks if the root action played without noise can still change:
+         * the best action is a proven win, or no other action can catch up
+         * with the most visited one in the sims that are left.
+         */
+        bool isMoveDecided(int remainingSims);
+
+        // Bytes held by the tree's node and edge arenas, including the spares
+        size_t memoryUsage();
+
+        // Nodes plus edges in the tree, the size counted by nodeBudget
+        size_t treeSize();
+
+        /**
+         * Drops the least visited subtrees until the tree has at most
+         * targetSize nodes and edges. The root and its edges are always kept.
+         */
+        void pruneTree(size_t targetSize);
+
+        /**
+         * Frees all of the tree's memory, eg once the game is over. The
+         * tree must be started again before it is searched.
+         */
+        void releaseMemory();
+
+        /**
+         * Saves the tree and its root position, so the search can be picked
+         * up again later with loadTree. Nothing can be waiting for the NN.
+         *
+         * @param maxDepth Most moves below the root to keep, 0 for no limit
+         * @param minVisits Children with fewer visits are saved as leaves
+         */
+        bool saveTree(string filename, int maxDepth, unsigned int minVisits);
+        bool saveTree(string filename);
+
+        /**
+         * Replaces the tree with one saved by saveTree. The tree can be
+         * searched straight away, starting from the saved root position.
+         * A file whose position or layout could not have been written by
+         * saveTree is rejected, and the tree is left as it was.
+         */
+        bool loadTree(string filename);
+
         vector<float> getActionProb();
+
+        /**
+         * Starts the Gumbel search of the root for a budget of sims. New
+         * Gumbel noise is sampled, and the root is evaluated first if it
+         * has no priors.
+         */
+        void startGumbelSearch(int sims);
+
+        /**
+         * The improved policy softmax(logit + sigma(completed q)) over the
+         * root actions, the training target of a Gumbel search.
+         */
+        vector<float> getImprovedPolicy();
+
+        /**
+         * Gets the action chosen by the Gumbel search, the best candidate
+         * left by sequential halving. Without noise the candidates are ranked
+         * on their priors and values alone, eg once moves are played greedily.
+         *
+         * @return The action index, or -1 if the root has no edges
+         */
+        int getGumbelAction(bool withNoise);
+
+        /**
+         * Gets the opening book action for the root position.
+         *
+         * @return The action index, or -1 if the position is not in the book
+         */
+        int getBookAction();
+
+        /**
+         * Plays the action at the root. The child's subtree becomes the new
+         * tree, so the simulations already spent on it are kept; the
+         * siblings are freed.
+         *
+         * @param reuseFraction The fraction of the visits in the subtree to
+         *                      keep, 0 discards the subtree
+         */
+        void takeAction(int actionIndex, float reuseFraction);
         void takeAction(int actionIndex);
         int getStatus();
         void displayGame();
@@ -81,6 +581,23 @@ class MCTS {
 
 };
 
+/**
+ * Stands in for the neural network when none is available, eg in the
+ * bench and the engine. Gives a uniform policy and the static evaluation
+ * squashed with tanh(eval / STATIC_EVAL_SCALE) as the value for X.
+ */
+void staticEvaluation(GameState &position, vector<float> &policy, float &v);
+
+/**
+ * The default positionEvaluator, runs staticEvaluation on every position.
+ */
+void staticBatchEvaluation(void *context, vector<GameState> &positions, vector<vector<float>> &policies, vector<float> &values);
+
+/**
+ * KL divergence of q from p, over the actions where p is not 0.
+ */
+float klDivergence(vector<float> &p, vector<float> &q);
+
 vector<vector<int>> getSymmetriesBoard(vector<int> board);
 vector<vector<float>> getSymmetriesPi(vector<float> pi);
 vector<trainingExampleVector> getSymmetries(trainingExampleVector position);
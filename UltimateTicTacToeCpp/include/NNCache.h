@@ -0,0 +1,100 @@
+#pragma once
+using namespace std;
+
+#include <GameState.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define NN_CACHE_SIZE_DEFAULT       100000  // Entries, about 34MB
+#define NN_CACHE_SHARDS             64
+
+/**
+ * A cached network evaluation. The policy is stored for the canonical
+ * orientation of the position, so every symmetric position can use it.
+ */
+struct nnCacheEntry {
+    unsigned long long key;
+    float policy[81];
+    float value;
+
+    // Cleared by the clock hand, set again on every hit
+    bool referenced;
+};
+
+struct nnCacheStats {
+    long long probes = 0;
+    long long hits = 0;
+    long long stores = 0;
+    long long evictions = 0;
+
+    double hitRate() {
+        return (probes > 0) ? (double) hits / probes : 0;
+    }
+};
+
+/**
+ * Fixed capacity cache of network evaluations shared by all self-play
+ * threads. Positions are keyed by their canonical hash, so the 8
+ * symmetric positions share one entry.
+ *
+ * The cache is split into shards with their own lock, picked by the top
+ * bits of the key. When a shard is full, an entry is replaced with the
+ * clock algorithm.
+ */
+class NNCache {
+    private:
+        struct shard {
+            mutex mtx;
+            vector<nnCacheEntry> entries;
+            unordered_map<unsigned long long, unsigned int> index;
+            unsigned int hand = 0;
+        };
+
+        unique_ptr<shard[]> shards;
+        int capacity = 0;
+        int shardCapacity = 0;
+
+        atomic<long long> probes, hits, stores, evictions;
+
+        shard &getShard(unsigned long long key);
+
+    public:
+        NNCache();
+        NNCache(int _capacity);
+
+        /**
+         * Changes the number of entries, 0 disables the cache.
+         * All entries are removed.
+         */
+        void resize(int _capacity);
+
+        /**
+         * Removes all entries, eg when the network changes.
+         */
+        void flush();
+
+        int getCapacity();
+
+        /**
+         * Looks up an evaluation.
+         *
+         * @param key The canonical hash from getCacheKey
+         * @param symmetry The symmetry from getCacheKey, used to map the policy
+         *                 back to the orientation of the position
+         * @return true if the position was found
+         */
+        bool probe(unsigned long long key, int symmetry, vector<float> &policy, float &value);
+        void store(unsigned long long key, int symmetry, vector<float> &policy, float value);
+
+        nnCacheStats getStats();
+        void resetStats();
+};
+
+/**
+ * Gets GameState::canonicalHash of the position, which includes the side
+ * to move, and the symmetry that turns it into its canonical orientation.
+ */
+void getCacheKey(GameState &position, unsigned long long &key, int &symmetry);
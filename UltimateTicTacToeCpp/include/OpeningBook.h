@@ -0,0 +1,93 @@
+#pragma once
+using namespace std;
+
+#include <GameState.h>
+#include <string>
+#include <vector>
+
+#define OPENING_BOOK_MAGIC          0x4B4F4F42  // "BOOK"
+#define OPENING_BOOK_VERSION        1
+
+#define BOOK_PLIES_DEFAULT          3
+#define BOOK_DEPTH_DEFAULT          10
+
+/**
+ * The opening book is stored as a header followed by entries sorted
+ * by key so it can be memory mapped and binary searched without any
+ * parse step.
+ */
+struct bookHeader {
+    unsigned int magic = OPENING_BOOK_MAGIC;
+    unsigned int version = OPENING_BOOK_VERSION;
+    unsigned int numEntries = 0;
+    unsigned int maxPly = 0;
+};
+
+/**
+ * Key is the canonical hash of the position. The action is stored for
+ * the canonical orientation (board * 9 + piece) and the score is from
+ * the perspective of the player to move.
+ */
+struct bookEntry {
+    unsigned long long key;
+    float score;
+    unsigned char action;
+    unsigned char depth;
+    unsigned short ply;
+};
+
+class OpeningBook {
+    private:
+        void *mapped = nullptr;
+        size_t mappedSize = 0;
+
+        const bookEntry *entries = nullptr;
+        unsigned int numEntries = 0;
+
+    public:
+        OpeningBook();
+        ~OpeningBook();
+
+        /**
+         * Memory maps the given book file, replacing any book that is
+         * already open.
+         *
+         * @return false if the file could not be opened or is not a valid book
+         */
+        bool open(string filename);
+        void close();
+
+        bool isOpen();
+        unsigned int size();
+
+        /**
+         * Looks up the given position in the book.
+         *
+         * @param action Set to the book action (board * 9 + piece) for the
+         *               position as given, not the canonical orientation
+         * @return true if the position was found
+         */
+        bool probe(GameState position, int &action);
+        bool probe(GameState position, int &action, bookEntry &entry);
+};
+
+/**
+ * The book used by minimaxSearch and MCTS. It is empty until
+ * loadOpeningBook is called.
+ */
+extern OpeningBook openingBook;
+
+bool loadOpeningBook(string filename);
+
+/**
+ * Sorts the entries and writes them to the given file in the format
+ * read by OpeningBook::open.
+ */
+bool writeOpeningBook(string filename, vector<bookEntry> entries, int maxPly);
+
+/**
+ * Gets every position reachable within the given number of plies from
+ * position, with symmetric duplicates removed. Each position is returned
+ * in its canonical orientation.
+ */
+vector<GameState> getBookPositions(GameState position, int plies);
@@ -0,0 +1,149 @@
+#pragma once
+using namespace std;
+
+#include <GameState.h>
+#include <MonteCarlo.h>
+#include <ProofNumber.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define PARALLEL_THREADS_DEFAULT    4
+#define PARALLEL_MAX_NODES_DEFAULT  200000
+#define PARALLEL_EDGES_PER_NODE     10      // Edges reserved per node, most nodes are never expanded
+#define PARALLEL_BATCH_WAIT_US      500     // Longest a leaf waits for the batch to fill
+
+#define PARALLEL_UNEXPANDED         0
+#define PARALLEL_EXPANDING          1
+#define PARALLEL_EXPANDED           2
+
+// Called with the number of finished playouts, returning true stops the search
+typedef function<bool(long long)> parallelStopCondition;
+
+/**
+ * A node of the shared tree. Visits and values are updated atomically.
+ * The edges are published by setting state to PARALLEL_EXPANDED after
+ * they are written.
+ */
+struct parallelNode {
+    unsigned int parent;
+    atomic<unsigned int> n;
+    atomic<float> w;
+
+    unsigned int firstEdge;
+    unsigned char action;
+    unsigned char numEdges;
+    atomic<unsigned char> state;
+};
+
+struct parallelEdge {
+    atomic<unsigned int> child;
+    float p;
+    unsigned char action;
+};
+
+/**
+ * Tree-parallel MCTS: several threads run playouts on one shared tree,
+ * for analysing a single position faster.
+ *
+ * Threads are spread over the tree with virtual loss. A leaf is expanded
+ * by the one thread that claims it; threads reaching a leaf that is
+ * being expanded undo their playout and start again. Nodes and edges
+ * come from fixed size pools with atomic counters, so no locks are held
+ * while searching. The leaves of all threads are evaluated together in
+ * batches.
+ */
+class ParallelMCTS {
+    private:
+        vector<parallelNode> nodes;
+        vector<parallelEdge> edges;
+        atomic<unsigned int> numNodes, numEdges;
+
+        unsigned int rootIndex;
+        GameState rootPosition;
+
+        atomic<bool> stopFlag;
+        atomic<long long> playouts;
+
+        // Only one batch is evaluated at a time, so the evaluator does not need to be thread safe
+        positionEvaluator evaluator = staticBatchEvaluation;
+        void *evaluatorContext = nullptr;
+
+        // Leaves waiting for an evaluation. A batch is evaluated once it is
+        // full, or by the first thread that has waited too long for it.
+        struct evaluationBatch {
+            vector<GameState> positions;
+            vector<vector<float>> policies;
+            vector<float> values;
+            bool done = false;
+        };
+
+        mutex batchMtx, evaluatorMtx;
+        condition_variable batchCv;
+        shared_ptr<evaluationBatch> currentBatch;
+
+        void evaluateBatch(shared_ptr<evaluationBatch> batch, unique_lock<mutex> &lock);
+        void evaluate(GameState &position, vector<float> &policy, float &v);
+
+        // Returns NO_NODE when the pool is full
+        unsigned int allocateNode(unsigned int parent, unsigned char action);
+
+        void addVisit(unsigned int node);
+        void undoVisits(unsigned int node);
+        void backpropagate(unsigned int node, GameState &position, float result);
+
+        /**
+         * Runs one playout from the root.
+         *
+         * @return false if it collided with another thread and was undone
+         */
+        bool playout();
+        void worker(long long maxPlayouts, parallelStopCondition shouldStop);
+
+        unsigned int mostVisitedChild(unsigned int node);
+
+    public:
+        ParallelMCTS();
+        ParallelMCTS(int _numThreads, float _cpuct, int maxNodes);
+
+        int numThreads = PARALLEL_THREADS_DEFAULT;
+        float cpuct = 1;
+        float virtualLoss = VIRTUAL_LOSS_DEFAULT;
+
+        // Largest number of leaves evaluated together, defaults to the number of threads
+        int batchSize = PARALLEL_THREADS_DEFAULT;
+
+        // Leaves with this many empty playable spots or fewer are solved instead of evaluated
+        int solverSpots = SOLVER_SPOTS_DEFAULT;
+
+        void setEvaluator(positionEvaluator _evaluator, void *context);
+
+        /**
+         * Searches the position with all threads, starting from an empty tree.
+         * Returns once maxPlayouts playouts are done (0 for no limit), the
+         * stop condition returns true, stop() is called or the pools are full.
+         */
+        void search(GameState position, long long maxPlayouts, parallelStopCondition shouldStop);
+        void search(GameState position, long long maxPlayouts);
+
+        /**
+         * Stops a running search, safe to call from any thread.
+         */
+        void stop();
+
+        long long getPlayouts();
+
+        // Visit counts of the root actions as a policy, like MCTS::getActionProb
+        vector<float> getActionProb();
+
+        // The most visited line from the root
+        vector<int> getPV(int maxLength);
+
+        // Mean value of the most visited root action for the player to move
+        float getBestValue();
+
+        size_t memoryUsage();
+};
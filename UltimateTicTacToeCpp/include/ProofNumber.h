@@ -0,0 +1,108 @@
+#pragma once
+using namespace std;
+
+#include <GameState.h>
+#include <vector>
+
+#define PN_TABLE_SIZE_DEFAULT       (1 << 18)
+#define PN_NODE_LIMIT_DEFAULT       20000
+
+// Positions with this many empty playable spots or fewer are given to the solver
+#define SOLVER_SPOTS_DEFAULT        12
+
+// The solver is called at every minimax leaf, so it is only used for the smallest endgames there
+#define SOLVER_LEAF_SPOTS_DEFAULT   6
+
+/**
+ * A transposition table entry for the proof-number search.
+ * Proof and disproof numbers are from the point of view of the attacker.
+ */
+struct pnEntry {
+    unsigned long long key = 0;
+    unsigned int pn = 1, dn = 1;
+    unsigned int work = 0;
+};
+
+/**
+ * Depth-first proof-number search (df-pn) endgame solver.
+ *
+ * Proves positions as won, lost or drawn. The transposition table has a
+ * fixed number of two-entry buckets and entries that took less work to
+ * compute are replaced first, so memory usage never grows.
+ */
+class ProofNumberSearch {
+    private:
+        vector<pnEntry> table;
+        unsigned long long tableMask;
+
+        int nodeLimit;
+
+        // The attacker is trying to win (or draw if drawIsWin)
+        int attacker;
+        bool drawIsWin;
+        unsigned long long runSalt;
+
+        void lookup(unsigned long long key, unsigned int &pn, unsigned int &dn);
+        void store(unsigned long long key, unsigned int pn, unsigned int dn, unsigned int work);
+
+        void terminalNumbers(GameState &position, unsigned int &pn, unsigned int &dn);
+
+        /**
+         * Expands the position until its proof number reaches pnThreshold
+         * or its disproof number reaches dnThreshold.
+         *
+         * @return The number of nodes searched below this position
+         */
+        unsigned int mid(GameState &position, unsigned int pnThreshold, unsigned int dnThreshold);
+
+        /**
+         * Tries to prove that the attacker wins from the given position.
+         *
+         * @return 1 if proven, 0 if disproven, -1 if the node limit was reached
+         */
+        int prove(GameState position, int _attacker, bool _drawIsWin);
+
+    public:
+        ProofNumberSearch();
+        ProofNumberSearch(int tableSize, int _nodeLimit);
+
+        // Statistics for the most recent call to solve
+        int nodesSearched = 0;
+
+        // Statistics since the solver was created
+        long long tableProbes = 0, tableHits = 0, tableStores = 0;
+
+        /**
+         * Solves the given position.
+         *
+         * 0: Unknown (node limit reached)
+         * 1: X wins
+         * 2: O wins
+         * 3: Tie
+         */
+        int solve(GameState position);
+
+        /**
+         * Solves the given position and gets the action (board * 9 + piece)
+         * that achieves the result. bestAction is -1 if the result is unknown.
+         */
+        int solve(GameState position, int &bestAction);
+
+        void setNodeLimit(int _nodeLimit);
+
+        /**
+         * Clears the transposition table.
+         */
+        void clear();
+};
+
+/**
+ * Gets the solver for the current thread. Each thread has its own
+ * table so the engines can use it without locking.
+ */
+ProofNumberSearch &getEndgameSolver();
+
+/**
+ * Counts the empty spots on miniboards that are still being played.
+ */
+int countRemainingSpots(GameState &position);
@@ -0,0 +1,102 @@
+#pragma once
+using namespace std;
+
+#include <GameState.h>
+#include <vector>
+
+#define ROLLOUTS_PER_LEAF_DEFAULT   16
+#define ROLLOUT_SEED_DEFAULT        0x2545F4914F6CDD1DULL
+
+// Prior weights of the heuristic policy, relative to 1 for a plain move
+#define HEURISTIC_WIN_BONUS         4       // Wins the miniboard
+#define HEURISTIC_BLOCK_BONUS       2       // Stops the opponent winning the miniboard
+#define HEURISTIC_FREE_MOVE_FACTOR  0.5     // Lets the opponent move on any board
+
+/**
+ * A position packed for random playouts. Each miniboard is a 9 bit mask
+ * per player, so a move is a few bit operations and a table lookup.
+ */
+struct rolloutBoard {
+    // Spots of X (0) and O (1) on each miniboard
+    unsigned short spots[2][9];
+
+    // Miniboards won by each player, and all decided miniboards including ties
+    unsigned short won[2];
+    unsigned short decided;
+
+    // -1 if any open miniboard can be moved on
+    int requiredBoard;
+
+    // 0 for X, 1 for O
+    int toMove;
+};
+
+/**
+ * Small xorshift generator for the playouts, much faster than mt19937.
+ */
+struct rolloutRandom {
+    unsigned long long state = ROLLOUT_SEED_DEFAULT;
+
+    unsigned long long next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+
+    // A number from 0 to range - 1
+    unsigned int below(unsigned int range) {
+        return (unsigned int) (((next() >> 32) * range) >> 32);
+    }
+};
+
+rolloutBoard packBoard(GameState &position);
+
+/**
+ * Plays random moves until the game ends.
+ *
+ * @return The final status of the game (1: X wins, 2: O wins, 3: Tie)
+ */
+int randomPlayout(rolloutBoard board, rolloutRandom &rng);
+
+/**
+ * Runs count random playouts from the board.
+ *
+ * @return The mean result for X, from -1 to 1
+ */
+float randomPlayouts(rolloutBoard &board, int count, rolloutRandom &rng);
+
+/**
+ * Reseeds the playout generator of the calling thread, so a single
+ * threaded search is repeatable. Each thread starts with a random seed.
+ */
+void seedRollouts(unsigned long long seed);
+
+/**
+ * Prior over the 81 actions that favours winning or saving miniboards,
+ * and avoids sending the opponent to a decided miniboard.
+ */
+void heuristicPolicy(GameState &position, vector<float> &policy);
+
+/**
+ * How uctEvaluation scores a leaf without the NN.
+ */
+struct uctOptions {
+    // Random playouts per leaf, 0 uses the static evaluation instead
+    int rolloutsPerLeaf = ROLLOUTS_PER_LEAF_DEFAULT;
+
+    // Uses heuristicPolicy for the priors instead of a uniform policy
+    bool heuristicPriors = false;
+};
+
+/**
+ * Scores a leaf for UCT search without the NN, giving a policy and a value
+ * for X in the same form as MCTS::searchPostNN.
+ */
+void uctEvaluation(uctOptions &options, GameState &position, vector<float> &policy, float &v);
+
+/**
+ * uctEvaluation for a batch of positions, usable as a positionEvaluator
+ * with a uctOptions as the context.
+ */
+void uctBatchEvaluation(void *context, vector<GameState> &positions, vector<vector<float>> &policies, vector<float> &values);
@@ -0,0 +1,322 @@
+#include "AsyncSearch.h"
+#include "GameState.h"
+#include "Minimax.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <math.h>
+
+using namespace std;
+
+AsyncSearch::AsyncSearch() {
+    stopFlag = false;
+    worker = thread(&AsyncSearch::workerLoop, this);
+}
+
+AsyncSearch::~AsyncSearch() {
+    jobMtx.lock();
+    quit = true;
+    stopFlag = true;
+    jobMtx.unlock();
+
+    jobCv.notify_all();
+    worker.join();
+
+    cancelTimer();
+}
+
+void AsyncSearch::workerLoop() {
+    unique_lock<mutex> lock(jobMtx);
+
+    while (true) {
+        jobCv.wait(lock, [this]() { return hasJob || quit; });
+
+        if (quit) {
+            return;
+        }
+
+        hasJob = false;
+        searching = true;
+
+        GameState position = jobPosition;
+        searchLimits limits = jobLimits;
+        constants c = jobConstants;
+        searchCallback callback = jobCallback;
+
+        lock.unlock();
+        run(position, limits, c, callback);
+        lock.lock();
+
+        searching = false;
+        jobCv.notify_all();
+    }
+}
+
+void AsyncSearch::postJob(GameState position, searchLimits limits, constants c, searchCallback callback) {
+    infoMtx.lock();
+    info = searchInfo();
+    searchPosition = position;
+    infoMtx.unlock();
+
+    stopFlag = false;
+
+    jobMtx.lock();
+    jobPosition = position;
+    jobLimits = limits;
+    jobConstants = c;
+    jobCallback = callback;
+    hasJob = true;
+    jobMtx.unlock();
+
+    jobCv.notify_all();
+}
+
+void AsyncSearch::startTimer(int moveTimeMs) {
+    cancelTimer();
+
+    timerCancelled = false;
+    timer = thread([this, moveTimeMs]() {
+        unique_lock<mutex> lock(timerMtx);
+
+        if (!timerCv.wait_for(lock, chrono::milliseconds(moveTimeMs), [this]() { return timerCancelled; })) {
+            stopFlag = true;
+        }
+    });
+}
+
+void AsyncSearch::cancelTimer() {
+    if (!timer.joinable()) {
+        return;
+    }
+
+    timerMtx.lock();
+    timerCancelled = true;
+    timerMtx.unlock();
+
+    timerCv.notify_all();
+    timer.join();
+}
+
+void AsyncSearch::start(GameState position, int maxDepth) {
+    constants c;
+    start(position, maxDepth, c, nullptr);
+}
+
+void AsyncSearch::start(GameState position, int maxDepth, constants c, searchCallback callback) {
+    searchLimits limits;
+    limits.maxDepth = maxDepth;
+
+    start(position, limits, c, callback);
+}
+
+void AsyncSearch::start(GameState position, searchLimits limits, constants c, searchCallback callback) {
+    stop();
+
+    infoMtx.lock();
+    pondering = false;
+    ponderAction = -1;
+    infoMtx.unlock();
+
+    postJob(position, limits, c, callback);
+
+    if (limits.moveTimeMs > 0) {
+        startTimer(limits.moveTimeMs);
+    }
+}
+
+void AsyncSearch::ponder(GameState position, int expectedAction, int maxDepth) {
+    constants c;
+    ponder(position, expectedAction, maxDepth, c, nullptr);
+}
+
+void AsyncSearch::ponder(GameState position, int expectedAction, int maxDepth, constants c, searchCallback callback) {
+    searchLimits limits;
+    limits.maxDepth = maxDepth;
+
+    ponder(position, expectedAction, limits, c, callback);
+}
+
+void AsyncSearch::ponder(GameState position, int expectedAction, searchLimits limits, constants c, searchCallback callback) {
+    stop();
+
+    position.move(expectedAction / 9, expectedAction % 9);
+
+    infoMtx.lock();
+    pondering = true;
+    ponderAction = expectedAction;
+    ponderMoveTimeMs = limits.moveTimeMs;
+    infoMtx.unlock();
+
+    // The clock starts on a ponder hit
+    limits.moveTimeMs = 0;
+    postJob(position, limits, c, callback);
+}
+
+bool AsyncSearch::ponderHit(int action) {
+    infoMtx.lock();
+    bool hit = pondering && action == ponderAction;
+    int moveTimeMs = ponderMoveTimeMs;
+
+    if (hit) {
+        // The search keeps running and is now the real search
+        pondering = false;
+        ponderAction = -1;
+    }
+    infoMtx.unlock();
+
+    if (!hit) {
+        stop();
+    } else if (moveTimeMs > 0) {
+        startTimer(moveTimeMs);
+    }
+
+    return hit;
+}
+
+void AsyncSearch::stop() {
+    stopFlag = true;
+    cancelTimer();
+    wait();
+}
+
+void AsyncSearch::wait() {
+    unique_lock<mutex> lock(jobMtx);
+    jobCv.wait(lock, [this]() { return !hasJob && !searching; });
+}
+
+bool AsyncSearch::isRunning() {
+    jobMtx.lock();
+    bool running = hasJob || searching;
+    jobMtx.unlock();
+
+    return running;
+}
+
+bool AsyncSearch::isPondering() {
+    infoMtx.lock();
+    bool result = pondering;
+    infoMtx.unlock();
+
+    return result;
+}
+
+searchInfo AsyncSearch::poll() {
+    infoMtx.lock();
+    searchInfo result = info;
+    infoMtx.unlock();
+
+    return result;
+}
+
+GameState AsyncSearch::getPosition() {
+    infoMtx.lock();
+    GameState result = searchPosition;
+    infoMtx.unlock();
+
+    return result;
+}
+
+void AsyncSearch::run(GameState position, searchLimits limits, constants c, searchCallback callback) {
+    /**
+     * Iterative deepening search. Root moves are ordered by the scores
+     * from the previous iteration, and an iteration that is stopped
+     * part way through is thrown away.
+     */
+    auto startTime = chrono::steady_clock::now();
+
+    // Searches on this thread check the stop flag at every node
+    minimaxStop = &stopFlag;
+    minimaxNodeLimit = limits.nodes;
+    beginSearchStats();
+
+    const float inf = numeric_limits<float>::infinity();
+    bool playAsX = position.getToMove() == 1;
+    int evalMultiplier = (playAsX) ? 1 : -1;
+
+    Node start = Node(position, 0);
+    start.addChildren();
+
+    vector<nodeAndEval> childEvals;
+    for (Node i : start.children) {
+        nodeAndEval childAndEval;
+        childAndEval.n = i;
+        childAndEval.e = evaluate(i.board, c) * evalMultiplier;
+        childEvals.push_back(childAndEval);
+    }
+
+    for (int depth = 1; depth <= limits.maxDepth && childEvals.size() > 0 && !stopFlag; depth++) {
+        std::sort(childEvals.begin(), childEvals.end(), compareEval);
+
+        pvLine best;
+        bool haveBest = false;
+        bool complete = true;
+
+        for (nodeAndEval &j : childEvals) {
+            Node i = j.n;
+            vector<int> childPV;
+
+            timeLimitedSearchResult result = minimaxTimeLimited(i, depth - 1, -1 * inf, inf, !playAsX, 0, c, &childPV);
+
+            if (!result.complete) {
+                complete = false;
+                break;
+            }
+
+            j.e = result.result * evalMultiplier;
+
+            pvLine line;
+            line.board = i.board;
+            line.eval = j.e;
+            line.mateDistance = isinf(j.e) ? i.infDepth : -1;
+            line.pv.push_back(i.board.previousMove.board * 9 + i.board.previousMove.piece);
+            line.pv.insert(line.pv.end(), childPV.begin(), childPV.end());
+
+            if (!haveBest || comparePVLine(line, best)) {
+                best = line;
+                haveBest = true;
+            }
+        }
+
+        if (!complete || !haveBest) {
+            break;
+        }
+
+        endSearchIteration(depth);
+        endSearchStats();
+
+        infoMtx.lock();
+        info.depth = depth;
+        info.stats = minimaxStats;
+        info.bestAction = best.pv[0];
+        info.eval = best.eval;
+        info.mateDistance = best.mateDistance;
+        info.pv = best.pv;
+        info.elapsedMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startTime).count();
+        searchInfo progress = info;
+        infoMtx.unlock();
+
+        if (callback) {
+            callback(progress);
+        }
+
+        // Deeper searches cannot change a forced result
+        if (isinf(best.eval)) {
+            break;
+        }
+    }
+
+    minimaxStop = nullptr;
+    minimaxNodeLimit = 0;
+    endSearchStats();
+
+    infoMtx.lock();
+    info.finished = true;
+    info.stats = minimaxStats;
+    info.elapsedMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startTime).count();
+    searchInfo progress = info;
+    infoMtx.unlock();
+
+    if (callback) {
+        callback(progress);
+    }
+}
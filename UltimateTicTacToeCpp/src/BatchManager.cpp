@@ -13,11 +13,15 @@ using namespace std;
 #include <iostream>
 #include <queue>
 #include <deque>
+#include <unordered_map>
 
 #define QUEUE_CHECK_DELAY       0.5ms
 
 int ongoingGames;
 
+// Worker threads that have finished all of their games, guarded by mtx
+int finishedWorkers;
+
 
 mutex mtx;
 queue<batch> needsEvaluation;
@@ -31,6 +35,11 @@ mutex resultsMTX;
 deque<vector<trainingExampleVector>> resultsHistory;
 vector<trainingExampleVector> results;
 
+NNCache cache;
+
+// Guarded by mtx
+treeMemoryStats treeStats;
+
 float RandomFloat(float a, float b) {
     float random = ((float) rand()) / (float) RAND_MAX;
     float diff = b - a;
@@ -106,6 +115,36 @@ void simple() {
     }
 }
 
+/**
+ * The leaves one episode selected for a NN round. Leaves found in the
+ * cache are filled in straight away, the rest are sent to the NN.
+ */
+struct episodeLeaves {
+    vector<vector<float>> policies;
+    vector<float> values;
+
+    // Indices of the leaves sent to the NN, the board in the batch that
+    // evaluates each one and the symmetry to its canonical orientation
+    vector<int> misses;
+    vector<int> batchIndices;
+    vector<int> symmetries;
+};
+
+vector<float> mapPolicySymmetry(vector<float> &policy, int fromSymmetry, int toSymmetry) {
+    if (fromSymmetry == toSymmetry) {
+        return policy;
+    }
+
+    vector<float> result(81);
+
+    for (int action = 0; action < 81; action++) {
+        // Through the canonical orientation that both positions share
+        result[action] = policy[actionFromSymmetry(actionToSymmetry(action, toSymmetry), fromSymmetry)];
+    }
+
+    return result;
+}
+
 void mctsWorker(int workerID, BatchManager *parent) {
 
     #ifdef PROFILE_ITERATIONS
@@ -124,6 +163,8 @@ void mctsWorker(int workerID, BatchManager *parent) {
     }
 
     for (MCTS &ep : episodes) {
+        ep.nodeBudget = parent->workerNodeBudget / episodes.size();
+        ep.freezeOnBudget = parent->freezeOnBudget;
         ep.startNewSearch(GameState());
     }
 
@@ -140,54 +181,183 @@ void mctsWorker(int workerID, BatchManager *parent) {
 
     while(remainingGames > 0) {
 
+        vector<episodeLeaves> leaves(episodes.size());
+
+        // Pick the moves that get a full search
+        vector<bool> fullSearch(episodes.size());
+        vector<int> targetSims(episodes.size());
+
+        for (size_t e = 0; e < episodes.size(); e++) {
+            fullSearch[e] = RandomFloat(0, 1) < parent->fullSearchProb;
+            targetSims[e] = fullSearch[e] ? parent->numSims : min(parent->fastSims, parent->numSims);
+
+            if (parent->gumbelRoot && !episodes[e].gameOver) {
+                MCTS &ep = episodes[e];
+
+                ep.gumbelRoot = true;
+                ep.gumbelTopK = parent->gumbelTopK;
+                ep.startGumbelSearch(targetSims[e] - (int) ep.getVisits(ep.rootIndex));
+            }
+        }
+
+        // Root visit distributions for the convergence check
+        vector<bool> stoppedEarly(episodes.size(), false);
+        vector<vector<float>> lastProbs(episodes.size());
+        vector<int> nextKLCheck(episodes.size(), KL_CHECK_INTERVAL);
+
+        // The move is played without noise, so only the most visited action matters
+        bool playsBestMove = actionsTaken + 1 >= TEMP_THRESHOLD;
+
         // Run all MCTS sims
         for (int i = 0; i < parent->numSims; i++) {
             batch needsEval;
             needsEval.workerID = workerID;
+            bool searched = false;
+
+            // Positions in the batch by canonical hash, with the symmetry of the board sent
+            unordered_map<unsigned long long, int> batchIndex;
+            vector<unsigned long long> batchKeys;
+            vector<int> batchSymmetries;
+            vector<GameState> batchPositions;
 
             // Prepare Batch
-            for (MCTS &ep : episodes) {
+            for (size_t e = 0; e < episodes.size(); e++) {
+                MCTS &ep = episodes[e];
+
                 if (ep.gameOver) {
                     continue;
                 }
-                // TODO: Reduce copying that is performed here
-                board2D newEval = ep.searchPreNN();
 
-                if (ep.evaluationNeeded) {
-                    needsEval.canonicalBoards.push_back(newEval);
+                // Visits kept from the last move count towards the sims
+                if ((int) ep.getVisits(ep.rootIndex) >= targetSims[e] || stoppedEarly[e]) {
+                    ep.evaluationNeeded = false;
+                    continue;
+                }
+
+                if (parent->earlyStop && !parent->gumbelRoot && playsBestMove && ep.isMoveDecided(targetSims[e] - ep.getVisits(ep.rootIndex))) {
+                    stoppedEarly[e] = true;
                 }
+
+                if (parent->earlyStopKL > 0 && !parent->gumbelRoot && (int) ep.getVisits(ep.rootIndex) >= nextKLCheck[e]) {
+                    vector<float> probs = ep.getActionProb();
+
+                    if (lastProbs[e].size() > 0 && klDivergence(probs, lastProbs[e]) < parent->earlyStopKL) {
+                        stoppedEarly[e] = true;
+                    }
+
+                    lastProbs[e] = probs;
+                    nextKLCheck[e] = ep.getVisits(ep.rootIndex) + KL_CHECK_INTERVAL;
+                }
+
+                if (stoppedEarly[e]) {
+                    ep.evaluationNeeded = false;
+                    continue;
+                }
+
+                searched = true;
+
+                // While every leaf is in the cache the episode is backed up and searched again
+                for (int retry = 0; retry < CACHE_RETRIES && (int) ep.getVisits(ep.rootIndex) < targetSims[e]; retry++) {
+                    // TODO: Reduce copying that is performed here
+                    vector<board2D> newEvals = ep.searchPreNN(parent->leavesPerTree);
+
+                    if (!ep.evaluationNeeded) {
+                        break;
+                    }
+
+                    episodeLeaves &epLeaves = leaves[e];
+                    int numLeaves = ep.pendingLeaves.size();
+
+                    epLeaves.policies.resize(numLeaves);
+                    epLeaves.values.resize(numLeaves);
+                    epLeaves.misses.clear();
+                    epLeaves.batchIndices.clear();
+                    epLeaves.symmetries.clear();
+
+                    for (int l = 0; l < numLeaves; l++) {
+                        unsigned long long key;
+                        int symmetry;
+                        getCacheKey(ep.pendingLeaves[l].position, key, symmetry);
+
+                        if (cache.probe(key, symmetry, epLeaves.policies[l], epLeaves.values[l])) {
+                            continue;
+                        }
+
+                        // Identical and symmetric positions share one board in the batch
+                        auto found = batchIndex.find(key);
+                        int index;
+
+                        if (found != batchIndex.end()) {
+                            index = found->second;
+                        } else {
+                            index = needsEval.canonicalBoards.size();
+                            batchIndex[key] = index;
+                            batchKeys.push_back(key);
+                            batchSymmetries.push_back(symmetry);
+                            needsEval.canonicalBoards.push_back(newEvals[l]);
+
+                            if (parent->useUCT) {
+                                batchPositions.push_back(ep.pendingLeaves[l].position);
+                            }
+                        }
+
+                        epLeaves.misses.push_back(l);
+                        epLeaves.batchIndices.push_back(index);
+                        epLeaves.symmetries.push_back(symmetry);
+                    }
+
+                    if (epLeaves.misses.size() > 0) {
+                        break;
+                    }
+
+                    ep.searchPostNN(epLeaves.policies, epLeaves.values);
+                }
+            }
+
+            if (!searched) {
+                break;
+            }
+
+            // Every leaf was found in the cache
+            if (needsEval.canonicalBoards.size() == 0) {
+                continue;
             }
 
             // t2 = chrono::steady_clock::now();
             // cout << "Batch creation took " << (float)chrono::duration_cast<std::chrono::milliseconds>(t2-t1).count()  << " milliseconds\n";
 
-            // Posting evaluation requires the lock
-            mtx.lock();
-            needsEvaluation.push(needsEval);
-            mtx.unlock();
+            // Without the NN the leaves are scored here instead of posting a batch
+            if (parent->useUCT) {
+                uctBatchEvaluation(&parent->uct, batchPositions, needsEval.pis, needsEval.evaluations);
+            } else {
+                // Posting evaluation requires the lock
+                mtx.lock();
+                needsEvaluation.push(needsEval);
+                mtx.unlock();
 
-            // Wait for the result
-            // auto t3 = chrono::steady_clock::now();
+                // Wait for the result
+                // auto t3 = chrono::steady_clock::now();
 
-            while (true) {
+                while (true) {
 
-                // If the result is available, get it
-                fromNNmtx[workerID].lock();
-                if (fromNN[workerID].size() > 0) {
-                    needsEval = fromNN[workerID].back();
-                    fromNN[workerID].pop_back();
-                    fromNNmtx[workerID].unlock();
-                    // cout << "GOT RESULTS BACK\n";
-                    // t1 = chrono::steady_clock::now();
-                    break;
-                }
+                    // If the result is available, get it
+                    fromNNmtx[workerID].lock();
+                    if (fromNN[workerID].size() > 0) {
+                        needsEval = fromNN[workerID].back();
+                        fromNN[workerID].pop_back();
+                        fromNNmtx[workerID].unlock();
+                        // cout << "GOT RESULTS BACK\n";
+                        // t1 = chrono::steady_clock::now();
+                        break;
+                    }
 
-                // cout << "Results are not back\n";
+                    // cout << "Results are not back\n";
 
-                fromNNmtx[workerID].unlock();
+                    fromNNmtx[workerID].unlock();
 
-                // Wait until checking again
-                this_thread::sleep_for(QUEUE_CHECK_DELAY);
+                    // Wait until checking again
+                    this_thread::sleep_for(QUEUE_CHECK_DELAY);
+                }
             }
 
             // auto t4 = chrono::steady_clock::now();
@@ -197,9 +367,13 @@ void mctsWorker(int workerID, BatchManager *parent) {
             // cout << "Broken out of loop EP SIZE " << episodes.size() << '\n';
 
 
+            for (size_t b = 0; b < needsEval.canonicalBoards.size(); b++) {
+                cache.store(batchKeys[b], batchSymmetries[b], needsEval.pis[b], needsEval.evaluations[b]);
+            }
+
             // Batch results
-            int resultsIndex = 0;
-            for (MCTS &ep : episodes) {
+            for (size_t e = 0; e < episodes.size(); e++) {
+                MCTS &ep = episodes[e];
 
                 if (ep.gameOver) {
                     continue;
@@ -216,34 +390,69 @@ void mctsWorker(int workerID, BatchManager *parent) {
 
                 // cout << "Game diplsayed\n";
 
-                ep.searchPostNN(needsEval.pis[resultsIndex], needsEval.evaluations[resultsIndex]);
+                episodeLeaves &epLeaves = leaves[e];
 
-                // cout << "Finishing search post nn\n";
+                for (size_t m = 0; m < epLeaves.misses.size(); m++) {
+                    int l = epLeaves.misses[m];
+                    int index = epLeaves.batchIndices[m];
 
-                // Move to the next set of results only if an evaluation was needed
-                resultsIndex += 1;
+                    epLeaves.policies[l] = mapPolicySymmetry(needsEval.pis[index], batchSymmetries[index], epLeaves.symmetries[m]);
+                    epLeaves.values[l] = needsEval.evaluations[index];
+                }
+
+                ep.searchPostNN(epLeaves.policies, epLeaves.values);
+
+                // cout << "Finishing search post nn\n";
             }
 
         }
 
         actionsTaken++;
 
-        // Make moves
+        // Trees are largest at the end of their search
+        long long workerBytes = 0, peakTreeBytes = 0, prunes = 0;
+
         for (MCTS &ep : episodes) {
+            long long bytes = ep.memoryUsage();
+
+            workerBytes += bytes;
+            peakTreeBytes = max(peakTreeBytes, bytes);
+            prunes += ep.prunes;
+            ep.prunes = 0;
+        }
+
+        mtx.lock();
+        treeStats.peakTreeBytes = max(treeStats.peakTreeBytes, peakTreeBytes);
+        treeStats.peakWorkerBytes = max(treeStats.peakWorkerBytes, workerBytes);
+        treeStats.prunes += prunes;
+        mtx.unlock();
+
+        // Make moves
+        for (size_t e = 0; e < episodes.size(); e++) {
+            MCTS &ep = episodes[e];
+
             if (ep.gameOver) {
                 continue;
             }
-            vector<float> probs = ep.getActionProb();
+            vector<float> probs = parent->gumbelRoot ? ep.getImprovedPolicy() : ep.getActionProb();
 
-            // Save probability before adding noise
-
-            ep.saveTrainingExample(probs, ep.rootNode.w / ep.rootNode.n);
+            // Save probability before adding noise, fast searches are too shallow to train on
+            if (fullSearch[e]) {
+                ep.saveTrainingExample(probs, ep.getValueSum(ep.rootIndex) / ep.getVisits(ep.rootIndex));
+            }
 
             int action;
+            float reuseFraction = REUSE_FRACTION_DEFAULT;
 
-            if (actionsTaken < TEMP_THRESHOLD) {
+            if (parent->gumbelRoot) {
+                // The Gumbel noise already explores, greedy moves rank the candidates without it
+                action = ep.getGumbelAction(actionsTaken < TEMP_THRESHOLD);
+            } else if (actionsTaken < TEMP_THRESHOLD && !fullSearch[e]) {
+                // Fast searches sample from the visits without noise
+                action = RandomActionWeighted(probs);
+            } else if (actionsTaken < TEMP_THRESHOLD) {
                 // Add dirichlet noise
-                int numActions = ep.rootNode.children.size();
+                int numActions = ep.getRoot().numEdges;
                 vector<double> dir = ep.dir(parent->dirichlet_a, numActions);
                 int i = 0;
                 for (float &prob : probs) {
@@ -254,11 +463,12 @@ void mctsWorker(int workerID, BatchManager *parent) {
                 }
         
                 action = RandomActionWeighted(probs);
+                reuseFraction = parent->noiseReuseFraction;
             } else {
                 action = MaxAction(probs);
             }
 
-            ep.takeAction(action);
+            ep.takeAction(action, reuseFraction);
             
 
             // ep.displayGame();
@@ -283,6 +493,7 @@ void mctsWorker(int workerID, BatchManager *parent) {
                 resultsMTX.unlock();
 
                 ep.gameOver = true;
+                ep.releaseMemory();
                 remainingGames--;
                 mtx.lock();
                 ongoingGames--;
@@ -304,9 +515,18 @@ void mctsWorker(int workerID, BatchManager *parent) {
         
 
     }
+
+    mtx.lock();
+    finishedWorkers++;
+    mtx.unlock();
 }
 
 void BatchManager::createMCTSThreads() {
+    mtx.lock();
+    treeStats = treeMemoryStats();
+    finishedWorkers = 0;
+    mtx.unlock();
+
     for (int i = 0; i < numThreads; i++) {
 
         vector<batch> fromNNVector;
@@ -366,6 +586,33 @@ int BatchManager::getOngoingGames() {
     return result;
 }
 
+bool BatchManager::workersFinished() {
+    mtx.lock();
+    bool result = finishedWorkers >= numThreads;
+    mtx.unlock();
+    return result;
+}
+
+void BatchManager::resizeCache(int size) {
+    cache.resize(size);
+}
+
+void BatchManager::flushCache() {
+    cache.flush();
+}
+
+nnCacheStats BatchManager::getCacheStats() {
+    return cache.getStats();
+}
+
+treeMemoryStats BatchManager::getTreeStats() {
+    mtx.lock();
+    treeMemoryStats stats = treeStats;
+    mtx.unlock();
+
+    return stats;
+}
+
 void addExampleToTrainingVector(trainingExampleVector *existing, trainingExampleVector *newEx) {
     // Average each value of pi
     int previousWeight = existing->timesSeen;
@@ -29,6 +29,18 @@ using namespace std;
 //     0b00001000100010000000,
 // };
 
+// Auto-generated using createGetSymmetries.py
+int symmetriesMappingSingleBoard[8][9] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8},
+    {2, 1, 0, 5, 4, 3, 8, 7, 6},
+    {2, 5, 8, 1, 4, 7, 0, 3, 6},
+    {8, 5, 2, 7, 4, 1, 6, 3, 0},
+    {8, 7, 6, 5, 4, 3, 2, 1, 0},
+    {6, 7, 8, 3, 4, 5, 0, 1, 2},
+    {6, 3, 0, 7, 4, 1, 8, 5, 2},
+    {0, 3, 6, 1, 4, 7, 2, 5, 8}
+};
+
     int checkMiniboardResultsWithTie(bitset<20> miniboard) {
         /**
          * Evaluates the give miniboard to check for a win, including the possibility that a square is tied.
@@ -555,6 +567,35 @@ using namespace std;
 
     }
 
+    int GameState::getValidActions(unsigned char actions[81]) {
+        /**
+         * Same as allPossibleMoves, but only the actions are saved so nothing is allocated.
+         */
+        int numActions = 0;
+        int requiredBoard = getRequiredBoard();
+
+        for (int boardIndex = 0; boardIndex < 9; boardIndex++) {
+            if (requiredBoard > -1 && boardIndex != requiredBoard) {
+                continue;
+            }
+
+            // If the game is over in this board, no moves are possible on it
+            if (requiredBoard == -1 && getBoardStatus(boardIndex))
+                continue;
+
+            for (int i = 0; i < 9; i++) {
+                int location = 2 + (i * 2);
+
+                if (!board[boardIndex][location] && !board[boardIndex][location + 1]) {
+                    actions[numActions] = boardIndex * 9 + i;
+                    numActions++;
+                }
+            }
+        }
+
+        return numActions;
+    }
+
     boardCoords GameState::absoluteIndexToBoardAndPiece(int i) {
         /**
          * Gets the board and piece of an absolute index of the full size 9x9 board.
@@ -1033,4 +1074,123 @@ GameState boardVector2GameState(vector<int> board) {
     result.updateMiniboardStatus();
 
     return result;    
-}
\ No newline at end of file
+}
+unsigned long long GameState::hash() {
+    /**
+     * Gets a 64-bit hash of the position.
+     *
+     * Only the spots, the player to move and the required board are
+     * hashed. The miniboard result bits are derived from the spots and
+     * unused bits of info may be stale, so neither are included.
+     */
+    unsigned long long h = 0x9E3779B97F4A7C15ULL;
+
+    h ^= (unsigned long long) (getToMove() * 16 + getRequiredBoard() + 1);
+
+    for (int i = 0; i < 9; i++) {
+        // Bits 2-19 hold the spots
+        h ^= (board[i].to_ulong() >> 2) + ((unsigned long long) i << 20);
+
+        // Mix so that each miniboard affects every bit of the result
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+    }
+
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+GameState GameState::getSymmetry(int symmetry) {
+    /**
+     * Gets the position transformed by the given symmetry. Spot p on
+     * miniboard b of the result is taken from spot mapping[p] on
+     * miniboard mapping[b] of this position.
+     */
+    GameState result;
+    int *mapping = symmetriesMappingSingleBoard[symmetry];
+
+    for (int b = 0; b < 9; b++) {
+        for (int p = 0; p < 9; p++) {
+            result.setPosition(b, p, getPosition(mapping[b], mapping[p]));
+        }
+
+        // Copy the miniboard results
+        result.board[b][0] = board[mapping[b]][0];
+        result.board[b][1] = board[mapping[b]][1];
+    }
+
+    result.setToMove(getToMove());
+
+    // Default is no required board
+    result.info &= ~(1 << 4);
+
+    int requiredBoard = getRequiredBoard();
+    if (requiredBoard != -1) {
+        result.setRequiredBoard(actionToSymmetry(requiredBoard * 9, symmetry) / 9);
+    }
+
+    if (previousMove.board != -1) {
+        int previousAction = actionToSymmetry(previousMove.board * 9 + previousMove.piece, symmetry);
+        result.previousMove.board = previousAction / 9;
+        result.previousMove.piece = previousAction % 9;
+    }
+
+    return result;
+}
+
+int GameState::getCanonicalSymmetry() {
+    int symmetry;
+    canonicalHash(symmetry);
+
+    return symmetry;
+}
+
+unsigned long long GameState::canonicalHash() {
+    int symmetry;
+
+    return canonicalHash(symmetry);
+}
+
+unsigned long long GameState::canonicalHash(int &symmetry) {
+    unsigned long long bestHash = hash();
+    symmetry = 0;
+
+    for (int s = 1; s < 8; s++) {
+        unsigned long long h = getSymmetry(s).hash();
+        if (h < bestHash) {
+            bestHash = h;
+            symmetry = s;
+        }
+    }
+
+    return bestHash;
+}
+
+int actionToSymmetry(int action, int symmetry) {
+    /**
+     * The symmetry gathers from mapping[i] into i, so the inverse
+     * is found by searching for where the board and piece came from.
+     */
+    int board = action / 9, piece = action % 9;
+    int newBoard = 0, newPiece = 0;
+
+    for (int i = 0; i < 9; i++) {
+        if (symmetriesMappingSingleBoard[symmetry][i] == board) {
+            newBoard = i;
+        }
+
+        if (symmetriesMappingSingleBoard[symmetry][i] == piece) {
+            newPiece = i;
+        }
+    }
+
+    return newBoard * 9 + newPiece;
+}
+
+int actionFromSymmetry(int action, int symmetry) {
+    int board = action / 9, piece = action % 9;
+
+    return symmetriesMappingSingleBoard[symmetry][board] * 9 + symmetriesMappingSingleBoard[symmetry][piece];
+}
@@ -0,0 +1,277 @@
+#include "Labeler.h"
+#include "GameState.h"
+#include "Minimax.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <math.h>
+#include <mutex>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static_assert(sizeof(labelRecord) == 64, "label records must stay 64 bytes");
+
+labelRecord labelPosition(GameState position, unsigned int index, labelOptions options) {
+    labelRecord record;
+    bool playAsX = position.getToMove() == 1;
+
+    record.index = index;
+    for (int b = 0; b < 9; b++) {
+        record.board[b] = position.board[b].to_ulong();
+    }
+    record.info = position.info;
+    record.mateDistance = -1;
+    record.bestAction = -1;
+    record.depth = 0;
+    record.pvLength = 0;
+
+    for (int i = 0; i < LABEL_PV_LENGTH; i++) {
+        record.pv[i] = -1;
+    }
+
+    // Finished games only have a score
+    if (position.getStatus() != 0) {
+        record.score = evaluate(position, options.c) * ((playAsX) ? 1 : -1);
+        return record;
+    }
+
+    pvLine best;
+
+    if (options.timeMs <= 0) {
+        best = minimaxSearchMultiPV(position, options.depth, playAsX, 1, options.c)[0];
+        record.depth = options.depth;
+    } else {
+        auto start = chrono::steady_clock::now();
+        long long previousUs = 0;
+
+        for (int depth = 1; depth <= LABEL_MAX_DEPTH; depth++) {
+            auto iterationStart = chrono::steady_clock::now();
+
+            best = minimaxSearchMultiPV(position, depth, playAsX, 1, options.c)[0];
+            record.depth = depth;
+
+            auto now = chrono::steady_clock::now();
+            long long iterationUs = chrono::duration_cast<chrono::microseconds>(now - iterationStart).count();
+            long long elapsedUs = chrono::duration_cast<chrono::microseconds>(now - start).count();
+
+            // Deeper searches cannot change a forced result
+            if (isinf(best.eval)) {
+                break;
+            }
+
+            // Predict the next iteration from how much this one grew
+            double growth = (previousUs > 0) ? (double) iterationUs / previousUs : getSearchStats().effectiveBranchingFactor();
+            if (elapsedUs + iterationUs * growth > options.timeMs * 1000LL) {
+                break;
+            }
+
+            previousUs = max(iterationUs, 1LL);
+        }
+    }
+
+    record.score = best.eval;
+    record.mateDistance = best.mateDistance;
+    record.bestAction = best.pv[0];
+    record.pvLength = min((int) best.pv.size(), LABEL_PV_LENGTH);
+
+    for (int i = 0; i < record.pvLength; i++) {
+        record.pv[i] = best.pv[i];
+    }
+
+    return record;
+}
+
+bool readLabelHeader(ifstream &file, string filename) {
+    labelHeader header;
+    file.read((char *) &header, sizeof(labelHeader));
+
+    if (!file || header.magic != LABEL_MAGIC || header.version != LABEL_VERSION || header.recordSize != sizeof(labelRecord)) {
+        cout << "Warning :: " << filename << " is not a valid label file\n";
+        return false;
+    }
+
+    return true;
+}
+
+long long labelPositions(vector<GameState> positions, string outputFile, labelOptions options) {
+    vector<unsigned int> indices(positions.size());
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        indices[i] = i;
+    }
+
+    return labelPositions(positions, indices, outputFile, options);
+}
+
+long long labelPositions(vector<GameState> positions, vector<unsigned int> indices, string outputFile, labelOptions options) {
+    if (indices.size() != positions.size()) {
+        cout << "Warning :: Got " << indices.size() << " indices for " << positions.size() << " positions\n";
+        return -1;
+    }
+
+    vector<bool> done(positions.size(), false);
+    long long alreadyDone = 0;
+
+    struct stat fileStat;
+    bool exists = stat(outputFile.c_str(), &fileStat) == 0 && fileStat.st_size > 0;
+
+    if (options.resume && exists) {
+        ifstream existing(outputFile, ios::binary);
+
+        if (!readLabelHeader(existing, outputFile)) {
+            return -1;
+        }
+
+        // A record that was only partly written when the run stopped is removed
+        long long numRecords = (fileStat.st_size - sizeof(labelHeader)) / sizeof(labelRecord);
+        labelRecord record;
+
+        for (long long i = 0; i < numRecords && existing.read((char *) &record, sizeof(labelRecord)); i++) {
+            auto found = lower_bound(indices.begin(), indices.end(), record.index);
+            size_t position = found - indices.begin();
+
+            if (found != indices.end() && *found == record.index && !done[position]) {
+                done[position] = true;
+                alreadyDone++;
+            }
+        }
+
+        existing.close();
+
+        if (truncate(outputFile.c_str(), sizeof(labelHeader) + numRecords * sizeof(labelRecord)) != 0) {
+            cout << "Warning :: Could not truncate " << outputFile << '\n';
+            return -1;
+        }
+
+        cout << "Resuming with " << alreadyDone << " / " << positions.size() << " positions already labeled\n";
+    } else {
+        ofstream created(outputFile, ios::binary | ios::trunc);
+
+        labelHeader header;
+        header.recordSize = sizeof(labelRecord);
+        created.write((const char *) &header, sizeof(labelHeader));
+
+        if (!created.good()) {
+            cout << "Warning :: Could not write label file " << outputFile << '\n';
+            return -1;
+        }
+    }
+
+    ofstream file(outputFile, ios::binary | ios::app);
+    if (!file) {
+        cout << "Warning :: Could not open label file " << outputFile << '\n';
+        return -1;
+    }
+
+    atomic<long long> nextPosition(0);
+    long long labeled = 0;
+    mutex fileMtx;
+
+    // Searches print nothing while labeling
+    bool verbose = minimaxVerbose;
+    minimaxVerbose = false;
+
+    auto start = chrono::steady_clock::now();
+
+    auto writeRecords = [&](vector<labelRecord> &records) {
+        fileMtx.lock();
+
+        file.write((const char *) records.data(), records.size() * sizeof(labelRecord));
+        file.flush();
+
+        long long before = labeled;
+        labeled += records.size();
+
+        if (labeled / options.reportInterval != before / options.reportInterval) {
+            double seconds = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count() / 1000.0;
+            cout << alreadyDone + labeled << " / " << positions.size() << " positions labeled, "
+                 << (long long) ((seconds > 0) ? labeled / seconds : 0) << " positions/s\n";
+        }
+
+        fileMtx.unlock();
+        records.clear();
+    };
+
+    // Each thread buffers its records and writes them in blocks
+    auto worker = [&]() {
+        vector<labelRecord> records;
+
+        while (true) {
+            long long index = nextPosition++;
+
+            if (index >= (long long) positions.size()) {
+                break;
+            }
+
+            if (done[index]) {
+                continue;
+            }
+
+            records.push_back(labelPosition(positions[index], indices[index], options));
+
+            if (records.size() >= LABEL_FLUSH_INTERVAL) {
+                writeRecords(records);
+            }
+        }
+
+        if (records.size() > 0) {
+            writeRecords(records);
+        }
+    };
+
+    vector<thread> workers;
+    for (int i = 0; i < max(options.numThreads, 1); i++) {
+        workers.push_back(thread(worker));
+    }
+
+    for (thread &t : workers) {
+        t.join();
+    }
+
+    minimaxVerbose = verbose;
+
+    if (!file.good()) {
+        cout << "Warning :: Error writing label file " << outputFile << '\n';
+        return -1;
+    }
+
+    return labeled;
+}
+
+vector<labelRecord> loadLabels(string filename) {
+    vector<labelRecord> records;
+    ifstream file(filename, ios::binary);
+
+    if (!file) {
+        cout << "Warning :: Could not open label file " << filename << '\n';
+        return records;
+    }
+
+    if (!readLabelHeader(file, filename)) {
+        return records;
+    }
+
+    labelRecord record;
+    while (file.read((char *) &record, sizeof(labelRecord))) {
+        records.push_back(record);
+    }
+
+    return records;
+}
+
+GameState labelRecordToGameState(labelRecord record) {
+    GameState position;
+
+    for (int b = 0; b < 9; b++) {
+        position.board[b] = bitset<20>(record.board[b]);
+    }
+    position.info = record.info;
+
+    return position;
+}
@@ -0,0 +1,271 @@
+#include "Match.h"
+#include "GameState.h"
+#include "Minimax.h"
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+using namespace std;
+
+int playGame(GameState position, engineConfig x, engineConfig o) {
+    GameState game = position;
+    boardCoords move;
+
+    while (game.getStatus() == 0) {
+        if (game.getToMove() == 1) {
+            move = minimaxSearchMove(game, x.depth, true, x.c);
+        } else {
+            move = minimaxSearchMove(game, o.depth, false, o.c);
+        }
+
+        game.move(move.board, move.piece);
+    }
+
+    return game.getStatus();
+}
+
+vector<GameState> generateOpenings(int count, int plies, unsigned int seed) {
+    vector<GameState> openings;
+    unordered_set<unsigned long long> seen;
+    mt19937 gen(seed);
+
+    // Give up eventually if there are not enough distinct openings
+    int attempts = 0;
+
+    while ((int) openings.size() < count && attempts < count * 100) {
+        attempts++;
+
+        GameState game;
+        for (int ply = 0; ply < plies && game.getStatus() == 0; ply++) {
+            vector<GameState> moves = game.allPossibleMoves();
+            game = moves[gen() % moves.size()];
+        }
+
+        if (game.getStatus() != 0) {
+            continue;
+        }
+
+        if (seen.insert(game.canonicalHash()).second) {
+            openings.push_back(game);
+        }
+    }
+
+    return openings;
+}
+
+vector<GameState> loadOpenings(string filename) {
+    vector<unsigned int> lineNumbers;
+    return loadOpenings(filename, lineNumbers);
+}
+
+vector<GameState> loadOpenings(string filename, vector<unsigned int> &lineNumbers) {
+    vector<GameState> openings;
+    ifstream file(filename);
+    string line;
+    unsigned int lineNumber = 0;
+
+    lineNumbers.clear();
+
+    if (!file) {
+        cout << "Warning :: Could not open openings file " << filename << '\n';
+        return openings;
+    }
+
+    while (getline(file, line)) {
+        istringstream actions(line);
+        GameState game;
+        int action;
+        bool valid = true, empty = true;
+
+        while (actions >> action) {
+            empty = false;
+
+            if (action < 0 || action > 80 || game.getStatus() != 0 || !game.isValidMove(action / 9, action % 9) || game.getBoardStatus(action / 9) != 0) {
+                valid = false;
+                break;
+            }
+
+            game.move(action / 9, action % 9);
+        }
+
+        if (!valid) {
+            cout << "Warning :: Skipping invalid opening " << line << '\n';
+        } else if (!empty && game.getStatus() == 0) {
+            openings.push_back(game);
+            lineNumbers.push_back(lineNumber);
+        }
+
+        lineNumber++;
+    }
+
+    return openings;
+}
+
+double scoreToElo(double score) {
+    return -400 * log10(1 / score - 1);
+}
+
+double eloToScore(double elo) {
+    return 1 / (1 + pow(10, -elo / 400));
+}
+
+double eloEstimate(matchResults results) {
+    double games = results.wins + results.losses + results.draws;
+
+    if (games == 0) {
+        return 0;
+    }
+
+    double score = (results.wins + 0.5 * results.draws) / games;
+
+    // Elo is infinite for a perfect or zero score
+    score = min(max(score, 0.5 / games), 1 - 0.5 / games);
+
+    return scoreToElo(score);
+}
+
+double eloErrorMargin(matchResults results) {
+    double games = results.wins + results.losses + results.draws;
+
+    if (games == 0) {
+        return 0;
+    }
+
+    double score = (results.wins + 0.5 * results.draws) / games;
+    score = min(max(score, 0.5 / games), 1 - 0.5 / games);
+
+    // Variance of a single game result
+    double variance = (results.wins * pow(1 - score, 2) + results.losses * pow(score, 2) + results.draws * pow(0.5 - score, 2)) / games;
+    double stdError = sqrt(variance / games);
+
+    // 95% confidence interval
+    double low = min(max(score - 1.96 * stdError, 0.5 / games), 1 - 0.5 / games);
+    double high = min(max(score + 1.96 * stdError, 0.5 / games), 1 - 0.5 / games);
+
+    return (scoreToElo(high) - scoreToElo(low)) / 2;
+}
+
+double sprtLLR(matchResults results, double elo0, double elo1) {
+    /**
+     * Gets the log-likelihood ratio using the normal approximation to the
+     * trinomial (win/draw/loss) distribution.
+     */
+    double games = results.wins + results.losses + results.draws;
+
+    if (games == 0) {
+        return 0;
+    }
+
+    double score = (results.wins + 0.5 * results.draws) / games;
+    double variance = (results.wins * pow(1 - score, 2) + results.losses * pow(score, 2) + results.draws * pow(0.5 - score, 2)) / games;
+
+    // Every game had the same result, eg a clean sweep of a much weaker
+    // engine. Estimate the variance as if one more game of each result
+    // had been played, so the test can still finish
+    if (variance <= 0) {
+        variance = (games * variance + pow(1 - score, 2) + pow(score, 2) + pow(0.5 - score, 2)) / (games + 3);
+    }
+
+    double score0 = eloToScore(elo0);
+    double score1 = eloToScore(elo1);
+
+    return (score1 - score0) * (2 * score - score0 - score1) / (2 * variance / games);
+}
+
+void printStandings(matchResults results, double llr, double lower, double upper) {
+    int games = results.wins + results.losses + results.draws;
+
+    cout << "Games " << games << " W " << results.wins << " L " << results.losses << " D " << results.draws
+         << " Elo " << eloEstimate(results) << " +/- " << eloErrorMargin(results)
+         << " LLR " << llr << " [" << lower << ", " << upper << "]\n";
+}
+
+matchResults runMatch(engineConfig a, engineConfig b, vector<GameState> openings, matchOptions options) {
+    matchResults results;
+
+    if (openings.size() == 0) {
+        cout << "Warning :: No openings to play\n";
+        return results;
+    }
+
+    double lower = log(options.beta / (1 - options.alpha));
+    double upper = log((1 - options.beta) / options.alpha);
+
+    atomic<int> nextGame(0);
+    atomic<bool> stop(false);
+    mutex resultsMtx;
+
+    // Searches print nothing while the match is running
+    bool verbose = minimaxVerbose;
+    minimaxVerbose = false;
+
+    auto worker = [&]() {
+        while (!stop) {
+            int gameIndex = nextGame++;
+
+            if (gameIndex >= options.maxGames) {
+                return;
+            }
+
+            // Each opening is played with both colors before moving on
+            GameState opening = openings[(gameIndex / 2) % openings.size()];
+            bool aIsX = gameIndex % 2 == 0;
+
+            int status = aIsX ? playGame(opening, a, b) : playGame(opening, b, a);
+
+            resultsMtx.lock();
+
+            if (status == 3) {
+                results.draws++;
+            } else if ((status == 1) == aIsX) {
+                results.wins++;
+            } else {
+                results.losses++;
+            }
+
+            double llr = sprtLLR(results, options.elo0, options.elo1);
+            int games = results.wins + results.losses + results.draws;
+
+            if (results.sprtResult == 0 && (llr >= upper || llr <= lower)) {
+                results.sprtResult = (llr >= upper) ? 1 : -1;
+                stop = true;
+            }
+
+            if (stop || games % options.reportInterval == 0) {
+                printStandings(results, llr, lower, upper);
+            }
+
+            resultsMtx.unlock();
+        }
+    };
+
+    vector<thread> workers;
+    for (int i = 0; i < max(options.numThreads, 1); i++) {
+        workers.push_back(thread(worker));
+    }
+
+    for (thread &t : workers) {
+        t.join();
+    }
+
+    minimaxVerbose = verbose;
+
+    // Games still being played when the test finished are included
+    printStandings(results, sprtLLR(results, options.elo0, options.elo1), lower, upper);
+
+    if (results.sprtResult == 1) {
+        cout << "SPRT: H1 accepted (elo >= " << options.elo1 << ")\n";
+    } else if (results.sprtResult == -1) {
+        cout << "SPRT: H0 accepted (elo <= " << options.elo0 << ")\n";
+    } else {
+        cout << "SPRT: no decision after " << options.maxGames << " games\n";
+    }
+
+    return results;
+}
@@ -1,14 +1,120 @@
 #include "Minimax.h"
 #include "GameState.h"
+#include "OpeningBook.h"
 #include <bitset>
 #include <math.h>
 #include <algorithm>
 #include <ctime>
+#include <chrono>
 
 using namespace std;
 
 
-unordered_map<bitset<20>, dualEvals> evaluationMap;
+// Each thread keeps its own cache so searches can run in parallel
+// The cache is only valid for the constants it was filled with
+thread_local unordered_map<bitset<20>, dualEvals> evaluationMap;
+thread_local constants evaluationMapConstants;
+
+bool minimaxVerbose = true;
+
+thread_local atomic<bool> *minimaxStop = nullptr;
+thread_local long long minimaxNodeLimit = 0;
+
+int minimaxSolverSpots = SOLVER_SPOTS_DEFAULT;
+int minimaxLeafSolverSpots = SOLVER_LEAF_SPOTS_DEFAULT;
+
+thread_local searchStats minimaxStats;
+
+// Where the current search started, so solver counts can be taken as differences
+thread_local chrono::steady_clock::time_point statsStartTime, statsIterationTime;
+thread_local long long statsIterationNodes, statsProbes, statsHits, statsStores;
+
+
+double searchStats::nodesPerSecond() {
+    return (elapsedUs > 0) ? nodes * 1000000.0 / elapsedUs : 0;
+}
+
+double searchStats::firstMoveCutoffRate() {
+    return (cutoffs > 0) ? (double) firstMoveCutoffs / cutoffs : 0;
+}
+
+double searchStats::evalCacheHitRate() {
+    return (evalCacheProbes > 0) ? (double) evalCacheHits / evalCacheProbes : 0;
+}
+
+double searchStats::ttHitRate() {
+    return (ttProbes > 0) ? (double) ttHits / ttProbes : 0;
+}
+
+double searchStats::effectiveBranchingFactor() {
+    int size = iterations.size();
+
+    if (size >= 2 && iterations[size - 2].nodes > 0) {
+        return (double) iterations[size - 1].nodes / iterations[size - 2].nodes;
+    }
+
+    if (depth > 0 && nodes > 0) {
+        return pow((double) nodes, 1.0 / depth);
+    }
+
+    return 0;
+}
+
+searchStats getSearchStats() {
+    return minimaxStats;
+}
+
+void printSearchStats(searchStats stats) {
+    cout << "depth " << stats.depth << " nodes " << stats.nodes << " leaves " << stats.leaves
+         << " time " << stats.elapsedUs / 1000 << "ms nps " << (long long) stats.nodesPerSecond()
+         << " ebf " << stats.effectiveBranchingFactor()
+         << " first move cutoffs " << stats.firstMoveCutoffRate() * 100 << "%"
+         << " eval cache hits " << stats.evalCacheHitRate() * 100 << "%"
+         << " tt probes " << stats.ttProbes << " hits " << stats.ttHits << " stores " << stats.ttStores << '\n';
+
+    for (iterationStats i : stats.iterations) {
+        cout << "  depth " << i.depth << " nodes " << i.nodes << " time " << i.elapsedUs / 1000 << "ms\n";
+    }
+}
+
+void beginSearchStats() {
+    ProofNumberSearch &solver = getEndgameSolver();
+
+    minimaxStats = searchStats();
+
+    statsStartTime = chrono::steady_clock::now();
+    statsIterationTime = statsStartTime;
+    statsIterationNodes = 0;
+
+    statsProbes = solver.tableProbes;
+    statsHits = solver.tableHits;
+    statsStores = solver.tableStores;
+}
+
+void endSearchIteration(int depth) {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    iterationStats iteration;
+    iteration.depth = depth;
+    iteration.nodes = minimaxStats.nodes - statsIterationNodes;
+    iteration.elapsedUs = chrono::duration_cast<chrono::microseconds>(now - statsIterationTime).count();
+
+    minimaxStats.iterations.push_back(iteration);
+    minimaxStats.depth = depth;
+
+    statsIterationTime = now;
+    statsIterationNodes = minimaxStats.nodes;
+}
+
+void endSearchStats() {
+    ProofNumberSearch &solver = getEndgameSolver();
+
+    minimaxStats.elapsedUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - statsStartTime).count();
+
+    minimaxStats.ttProbes = solver.tableProbes - statsProbes;
+    minimaxStats.ttHits = solver.tableHits - statsHits;
+    minimaxStats.ttStores = solver.tableStores - statsStores;
+}
 
 
 float evaluate(GameState board, constants c) {
@@ -21,6 +127,12 @@ float evaluate(GameState board, constants c) {
 
     float finalEval = 0;
 
+    // Engines with different constants can share a thread, eg in computerVcomputer
+    if (!(c == evaluationMapConstants)) {
+        evaluationMap.clear();
+        evaluationMapConstants = c;
+    }
+
     int status = board.getStatus();
     if (status == 1) { // X wins
         return numeric_limits<float>::infinity();
@@ -35,8 +147,11 @@ float evaluate(GameState board, constants c) {
         bitset<20> currentMiniboard = position[i];
         auto matchingPattern = evaluationMap.find(currentMiniboard);
 
+        minimaxStats.evalCacheProbes++;
+
         // If the position is saved, use the saved evaluations
         if (matchingPattern != evaluationMap.end()) {
+            minimaxStats.evalCacheHits++;
             miniboardEvalsX[i] = matchingPattern->second.x;
             miniboardEvalsO[i] = matchingPattern->second.o;
         } else {
@@ -269,21 +384,35 @@ float minimax(Node (&node), int depth, float alpha, float beta, bool maximizingP
 };
 
 timeLimitedSearchResult minimaxTimeLimited(Node (&node), int depth, float alpha, float beta, bool maximizingPlayer, int time, constants c) {
+    return minimaxTimeLimited(node, depth, alpha, beta, maximizingPlayer, time, c, nullptr);
+};
+
+timeLimitedSearchResult minimaxTimeLimited(Node (&node), int depth, float alpha, float beta, bool maximizingPlayer, int time, constants c, vector<int> *pv) {
     /**
      * Calculates the evaluation of the given board to the given depth.
      * Note that updateMiniboardStatus() or updateSignleMiniboardStatus() must be called before this function.
+     *
+     * If pv is given, it is set to the actions of the principal variation from this node.
      */
 
     timeLimitedSearchResult result;
 
+    if (pv != nullptr) {
+        pv->clear();
+    }
+
 
-    // Check if the search time has expired
-    if (time > 0 && std::time(nullptr) > time) {
+    // Check if the search time has expired or the search was stopped
+    if ((time > 0 && std::time(nullptr) > time) || (minimaxStop != nullptr && minimaxStop->load(memory_order_relaxed))
+        || (minimaxNodeLimit > 0 && minimaxStats.nodes >= minimaxNodeLimit)) {
         result.complete = false;
         result.result = 0;
         return result;
     }
 
+    searchStats &stats = minimaxStats;
+    stats.nodes++;
+
     float bestEval, newEval;
 
     const float inf = numeric_limits<float>::infinity();
@@ -296,11 +425,28 @@ timeLimitedSearchResult minimaxTimeLimited(Node (&node), int depth, float alpha,
 
     // Check if depth is reached or game is over
     if (depth <= 0 || node.board.getStatus() != 0) {
+        stats.leaves++;
         bestEval = evaluate(node.board, c);
 
+        int solved = 0;
+
+        // Replace the heuristic with the exact result if the endgame can be solved
+        if (node.board.getStatus() == 0 && countRemainingSpots(node.board) <= minimaxLeafSolverSpots) {
+            solved = getEndgameSolver().solve(node.board);
+
+            if (solved == 1) {
+                bestEval = inf;
+            } else if (solved == 2) {
+                bestEval = -1 * inf;
+            } else if (solved == 3) {
+                bestEval = 0;
+            }
+        }
+
         if (isinf(bestEval)) {
             // Save the depth if the evaluation is infinite
-            node.infDepth = node.depth;
+            // A solved result is at least one move further away than the leaf
+            node.infDepth = (solved) ? node.depth + 1 : node.depth;
         }
 
         result.result = bestEval;
@@ -317,9 +463,28 @@ timeLimitedSearchResult minimaxTimeLimited(Node (&node), int depth, float alpha,
 
     node.addChildren();
 
-    
+    int childIndex = -1;
+
     for (Node i : node.children) {
-        newEval = minimax(i, depth - 1, alpha, beta, !maximizingPlayer, c);
+        childIndex++;
+        vector<int> childPV;
+        timeLimitedSearchResult childResult = minimaxTimeLimited(i, depth - 1, alpha, beta, !maximizingPlayer, 0, c, (pv != nullptr) ? &childPV : nullptr);
+
+        // Only a stopped search is incomplete below the root
+        if (!childResult.complete) {
+            result.complete = false;
+            result.result = 0;
+            return result;
+        }
+
+        newEval = childResult.result;
+
+        // Save the principal variation when a new best move is found
+        if (pv != nullptr && (pv->empty() || (maximizingPlayer && newEval > bestEval) || (!maximizingPlayer && newEval < bestEval))) {
+            pv->clear();
+            pv->push_back(i.board.previousMove.board * 9 + i.board.previousMove.piece);
+            pv->insert(pv->end(), childPV.begin(), childPV.end());
+        }
 
         if (maximizingPlayer) {
             // Get the highest evaluation
@@ -350,6 +515,8 @@ timeLimitedSearchResult minimaxTimeLimited(Node (&node), int depth, float alpha,
 
             // Prune the position
             if (beta <= alpha) {
+                stats.cutoffs++;
+                stats.firstMoveCutoffs += (childIndex == 0);
                 break;
             }
         } else {
@@ -380,6 +547,8 @@ timeLimitedSearchResult minimaxTimeLimited(Node (&node), int depth, float alpha,
 
             // Prune the position
             if (beta <= alpha) {
+                stats.cutoffs++;
+                stats.firstMoveCutoffs += (childIndex == 0);
                 break;
             }
         }
@@ -398,6 +567,54 @@ GameState minimaxSearch(GameState position, int depth, bool playAsX) {
 }
 
 GameState minimaxSearch(GameState position, int depth, bool playAsX, constants c) {
+    int bookAction;
+
+    // Opening moves are taken from the book without searching
+    if (openingBook.probe(position, bookAction)) {
+        beginSearchStats();
+        position.move(bookAction / 9, bookAction % 9);
+        return position;
+    }
+
+    return minimaxSearchResult(position, depth, playAsX, c).board;
+};
+
+bool solveRoot(GameState position, bool playAsX, searchResult &result) {
+    /**
+     * Solves small endgames exactly. Lost positions are not returned so
+     * that they are still searched and the loss is delayed as long as possible.
+     *
+     * @return true if result was set to a winning or drawing move
+     */
+    if (countRemainingSpots(position) > minimaxSolverSpots) {
+        return false;
+    }
+
+    int solvedAction;
+    int solved = getEndgameSolver().solve(position, solvedAction);
+    int player = (playAsX) ? 1 : 2;
+
+    if (solvedAction == -1 || (solved != player && solved != 3)) {
+        return false;
+    }
+
+    result.board = position;
+    result.board.move(solvedAction / 9, solvedAction % 9);
+    result.eval = (solved == 3) ? 0 : numeric_limits<float>::infinity();
+
+    return true;
+}
+
+searchResult minimaxSearchResult(GameState position, int depth, bool playAsX, constants c) {
+    searchResult result;
+
+    beginSearchStats();
+
+    if (solveRoot(position, playAsX, result)) {
+        endSearchStats();
+        return result;
+    }
+
     Node start = Node(position, 0);
 
     start.addChildren();
@@ -438,18 +655,30 @@ GameState minimaxSearch(GameState position, int depth, bool playAsX, constants c
 
     }
 
+    endSearchIteration(depth);
+    endSearchStats();
+
+    result.eval = bestEval;
+
     // Return the correct forced result board if necessary
     if (bestEval == inf) {
-        cout << "Forced win: " << shortestWinDepth << '\n';
-        return winNode.board;
+        if (minimaxVerbose)
+            cout << "Forced win: " << shortestWinDepth << '\n';
+        result.board = winNode.board;
+        result.infDepth = shortestWinDepth;
+        return result;
     }
     
     if (bestEval == -1 * inf) {
-        cout << "Forced loss: " << longestLoseDepth << '\n';
-        return loseNode.board;
+        if (minimaxVerbose)
+            cout << "Forced loss: " << longestLoseDepth << '\n';
+        result.board = loseNode.board;
+        result.infDepth = longestLoseDepth;
+        return result;
     }
 
-    return bestMove.board;
+    result.board = bestMove.board;
+    return result;
 };
 
 boardCoords minimaxSearchMove(GameState position, int depth, bool playAsX) {
@@ -469,6 +698,21 @@ GameState minimaxSearchTime(GameState position, int time, bool playAsX)  {
 
 GameState minimaxSearchTime(GameState position, int time, bool playAsX, constants c) {
 
+    int bookAction;
+
+    beginSearchStats();
+
+    if (openingBook.probe(position, bookAction)) {
+        position.move(bookAction / 9, bookAction % 9);
+        return position;
+    }
+
+    searchResult solvedResult;
+    if (solveRoot(position, playAsX, solvedResult)) {
+        endSearchStats();
+        return solvedResult.board;
+    }
+
     int endTime = std::time(nullptr) + time;
 
     Node start = Node(position, 0);
@@ -516,6 +760,7 @@ GameState minimaxSearchTime(GameState position, int time, bool playAsX, constant
 
             // If time has expired, return the best fully searched move
             if (!result.complete) {
+                endSearchStats();
                 return bestFullySearchedMove.board;
             }
 
@@ -545,14 +790,20 @@ GameState minimaxSearchTime(GameState position, int time, bool playAsX, constant
 
         }
 
+        endSearchIteration(depth);
+
         // Return the correct forced result board if necessary
         if (bestEval == inf) {
-            cout << "Forced win: " << shortestWinDepth << '\n';
+            if (minimaxVerbose)
+                cout << "Forced win: " << shortestWinDepth << '\n';
+            endSearchStats();
             return winNode.board;
         }
         
         if (bestEval == -1 * inf) {
-            cout << "Forced loss: " << longestLoseDepth << '\n';
+            if (minimaxVerbose)
+                cout << "Forced loss: " << longestLoseDepth << '\n';
+            endSearchStats();
             return loseNode.board;
         }
 
@@ -568,6 +819,117 @@ boardCoords minimaxSearchTimeMove(GameState position, int time, bool playAsX, co
     return minimaxSearchTime(position, time, playAsX, c).previousMove;
 };
 
+bool comparePVLine(pvLine a, pvLine b) {
+    /**
+     * Orders lines best first. Forced wins are ordered shortest first
+     * and forced losses longest first.
+     */
+    const float inf = numeric_limits<float>::infinity();
+
+    if (a.eval != b.eval) {
+        return a.eval > b.eval;
+    }
+
+    if (a.eval == inf) {
+        return a.mateDistance < b.mateDistance;
+    }
+
+    if (a.eval == -1 * inf) {
+        return a.mateDistance > b.mateDistance;
+    }
+
+    return false;
+}
+
+vector<pvLine> minimaxSearchMultiPV(GameState position, int depth, bool playAsX, int numPV) {
+    constants c;
+    return minimaxSearchMultiPV(position, depth, playAsX, numPV, c);
+}
+
+vector<pvLine> minimaxSearchMultiPV(GameState position, int depth, bool playAsX, int numPV, constants c) {
+    /**
+     * Searches every root move, keeping the best numPV.
+     *
+     * Once numPV lines are found, the remaining moves are searched with a
+     * window that only admits moves better than the worst line kept. Moves
+     * that fail low are not in the top numPV and are cut off early, so the
+     * search costs far less than numPV separate searches.
+     */
+    vector<pvLine> lines;
+
+    if (numPV < 1) {
+        cout << "Warning :: numPV must be at least 1, got " << numPV << '\n';
+        return lines;
+    }
+
+    Node start = Node(position, 0);
+
+    beginSearchStats();
+
+    start.addChildren();
+
+    const float inf = numeric_limits<float>::infinity();
+    int evalMultiplier = (playAsX) ? 1 : -1;
+
+    // Search the statically best moves first so the window narrows quickly
+    vector<nodeAndEval> childEvals;
+    for (Node i : start.children) {
+        nodeAndEval childAndEval;
+        childAndEval.n = i;
+        childAndEval.e = evaluate(i.board, c) * evalMultiplier;
+        childEvals.push_back(childAndEval);
+    }
+
+    std::sort(childEvals.begin(), childEvals.end(), compareEval);
+
+    for (nodeAndEval &j : childEvals) {
+        Node i = j.n;
+        float alpha = -1 * inf, beta = inf;
+
+        // The worst line kept, from the perspective of the searching player
+        if ((int) lines.size() >= numPV) {
+            float threshold = lines.back().eval;
+
+            // Forced results are still ordered by mate distance, so they do not narrow the window
+            if (!isinf(threshold)) {
+                if (playAsX) {
+                    alpha = threshold;
+                } else {
+                    beta = -1 * threshold;
+                }
+            }
+        }
+
+        vector<int> childPV;
+        float newEval = minimaxTimeLimited(i, depth - 1, alpha, beta, !playAsX, 0, c, &childPV).result;
+        newEval *= evalMultiplier;
+
+        pvLine line;
+        line.board = i.board;
+        line.eval = newEval;
+        line.mateDistance = isinf(newEval) ? i.infDepth : -1;
+        line.pv.push_back(i.board.previousMove.board * 9 + i.board.previousMove.piece);
+        line.pv.insert(line.pv.end(), childPV.begin(), childPV.end());
+
+        // Fail low: the move is no better than any of the lines already kept
+        if ((int) lines.size() >= numPV && !comparePVLine(line, lines.back())) {
+            continue;
+        }
+
+        lines.push_back(line);
+        std::sort(lines.begin(), lines.end(), comparePVLine);
+
+        if ((int) lines.size() > numPV) {
+            lines.pop_back();
+        }
+    }
+
+    endSearchIteration(depth);
+    endSearchStats();
+
+    return lines;
+}
+
 int computerVcomputer(int depth1, constants c1, int depth2, constants c2, bool displayGames) {
     GameState game;
     boardCoords move;
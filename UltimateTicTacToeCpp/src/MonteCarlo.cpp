@@ -1,21 +1,25 @@
 #include <MonteCarlo.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
 #include <limits>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include <iostream>
 using namespace std;
 
-// These arrays are auto-generated using createGetSymmetries.py
+random_device rd;
 
-int symmetriesMappingSingleBoard[8][9] = {
-    {0, 1, 2, 3, 4, 5, 6, 7, 8},
-    {2, 1, 0, 5, 4, 3, 8, 7, 6},
-    {2, 5, 8, 1, 4, 7, 0, 3, 6},
-    {8, 5, 2, 7, 4, 1, 6, 3, 0},
-    {8, 7, 6, 5, 4, 3, 2, 1, 0},
-    {6, 7, 8, 3, 4, 5, 0, 1, 2},
-    {6, 3, 0, 7, 4, 1, 8, 5, 2},
-    {0, 3, 6, 1, 4, 7, 2, 5, 8}
-};
+// These arrays are auto-generated using createGetSymmetries.py
 
 int symmetriesMapping[8][199] = {
     {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95, 96, 97, 98, 99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111, 112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143, 144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159, 160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175, 176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191, 192, 193, 194, 195, 196, 197, 198}, 
@@ -40,9 +44,147 @@ int piSymmetriesMapping[8][81] = {
 };
 
 
+unsigned int EdgeArena::allocate(int count) {
+    unsigned int first = child.size();
+
+    child.resize(first + count, NO_NODE);
+    n.resize(first + count, 0);
+    w.resize(first + count, 0);
+    p.resize(first + count, 0);
+    proven.resize(first + count, PROVEN_NONE);
+    action.resize(first + count, 0);
+
+    return first;
+}
+
+void EdgeArena::reset() {
+    child.clear();
+    n.clear();
+    w.clear();
+    p.clear();
+    proven.clear();
+    action.clear();
+}
+
+void EdgeArena::release() {
+    vector<unsigned int>().swap(child);
+    vector<unsigned int>().swap(n);
+    vector<float>().swap(w);
+    vector<float>().swap(p);
+    vector<unsigned char>().swap(proven);
+    vector<unsigned char>().swap(action);
+}
+
+void EdgeArena::swap(EdgeArena &other) {
+    child.swap(other.child);
+    n.swap(other.n);
+    w.swap(other.w);
+    p.swap(other.p);
+    proven.swap(other.proven);
+    action.swap(other.action);
+}
+
+void EdgeArena::copy(unsigned int index, EdgeArena &from, unsigned int fromIndex) {
+    child[index] = from.child[fromIndex];
+    n[index] = from.n[fromIndex];
+    w[index] = from.w[fromIndex];
+    p[index] = from.p[fromIndex];
+    proven[index] = from.proven[fromIndex];
+    action[index] = from.action[fromIndex];
+}
+
+size_t EdgeArena::size() {
+    return child.size();
+}
+
+size_t EdgeArena::memoryUsage() {
+    return child.capacity() * sizeof(unsigned int) + n.capacity() * sizeof(unsigned int) + w.capacity() * sizeof(float)
+         + p.capacity() * sizeof(float) + proven.capacity() + action.capacity();
+}
+
+int selectPUCT(EdgeArena &edges, unsigned int first, int count, float scale) {
+    const unsigned int *n = edges.n.data() + first;
+    const float *w = edges.w.data() + first;
+    const float *p = edges.p.data() + first;
+    const unsigned char *proven = edges.proven.data() + first;
+
+    const float infinity = numeric_limits<float>::infinity();
+
+    float bestScore = -infinity;
+    int best = -1;
+    int i = 0;
+
+#ifdef __AVX2__
+    if (count >= 8) {
+        const __m256 one = _mm256_set1_ps(1);
+        const __m256 scaleVec = _mm256_set1_ps(scale);
+        const __m256 unvisited = _mm256_set1_ps(infinity);
+        const __m256 skipped = _mm256_set1_ps(-infinity);
+        const __m256i zero = _mm256_setzero_si256();
+
+        __m256 bestScores = skipped;
+        __m256i bestIndices = _mm256_set1_epi32(-1);
+        __m256i indices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i step = _mm256_set1_epi32(8);
+
+        for (; i + 8 <= count; i += 8) {
+            __m256i visits = _mm256_loadu_si256((const __m256i *) (n + i));
+            __m256 nf = _mm256_cvtepi32_ps(visits);
+
+            __m256 q = _mm256_div_ps(_mm256_loadu_ps(w + i), nf);
+            __m256 u = _mm256_div_ps(_mm256_mul_ps(scaleVec, _mm256_loadu_ps(p + i)), _mm256_add_ps(one, nf));
+            __m256 score = _mm256_add_ps(q, u);
+
+            // Unvisited edges come first, proven edges are never picked
+            score = _mm256_blendv_ps(score, unvisited, _mm256_castsi256_ps(_mm256_cmpeq_epi32(visits, zero)));
+
+            __m256i provenLanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (proven + i)));
+            score = _mm256_blendv_ps(score, skipped, _mm256_castsi256_ps(_mm256_cmpgt_epi32(provenLanes, zero)));
+
+            // Each lane keeps its first best edge
+            __m256 better = _mm256_cmp_ps(score, bestScores, _CMP_GT_OQ);
+            bestScores = _mm256_blendv_ps(bestScores, score, better);
+            bestIndices = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIndices), _mm256_castsi256_ps(indices), better));
+
+            indices = _mm256_add_epi32(indices, step);
+        }
+
+        float laneScores[8];
+        int laneIndices[8];
+        _mm256_storeu_ps(laneScores, bestScores);
+        _mm256_storeu_si256((__m256i *) laneIndices, bestIndices);
+
+        // The lowest index wins a tie, as in the scalar loop
+        for (int lane = 0; lane < 8; lane++) {
+            if (laneIndices[lane] != -1 && (laneScores[lane] > bestScore || (laneScores[lane] == bestScore && laneIndices[lane] < best))) {
+                bestScore = laneScores[lane];
+                best = laneIndices[lane];
+            }
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (proven[i] != PROVEN_NONE) {
+            continue;
+        }
+
+        float score = (n[i] == 0) ? infinity : w[i] / n[i] + scale * p[i] / (1 + (float) n[i]);
+
+        if (score > bestScore) {
+            bestScore = score;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
 MCTS::MCTS() {
     gen = mt19937(rd());
     dirichlet = dirichlet_distribution<mt19937>(dirichlet_a, 81);
+
+    resetTree();
 }
 
 MCTS::MCTS(float _cpuct, double _dirichlet, float _percent_q) {
@@ -52,70 +194,319 @@ MCTS::MCTS(float _cpuct, double _dirichlet, float _percent_q) {
 
     gen = mt19937(rd());
     dirichlet = dirichlet_distribution<mt19937>(dirichlet_a, 81);
+
+    resetTree();
+}
+
+void MCTS::resetTree() {
+    // The whole tree is freed at once
+    tree.reset();
+    edges.reset();
+
+    rootIndex = tree.allocate(1);
+    tree[rootIndex].edge = edges.allocate(1);
 }
 
 void MCTS::startNewSearch(GameState position) {
-    rootNode = Node(position, 0);
-    rootNode.addChildren();
+    resetTree();
+    pendingLeaves.clear();
+
+    // A Gumbel search only runs once it is started for the new root
+    gumbelSims = 0;
+    gumbelCandidates.clear();
+
+    rootPosition = position;
+
+    addChildren(rootIndex, rootPosition);
+}
+
+void MCTS::addChildren(unsigned int node, GameState &position) {
+    if (tree[node].hasChildren) {
+        return;
+    }
+
+    unsigned char actions[81];
+    int numActions = position.getValidActions(actions);
+
+    if (numActions == 0) {
+        return;
+    }
+
+    unsigned int firstEdge = edges.allocate(numActions);
+
+    for (int i = 0; i < numActions; i++) {
+        edges.action[firstEdge + i] = actions[i];
+    }
+
+    tree[node].firstEdge = firstEdge;
+    tree[node].numEdges = numActions;
+    tree[node].hasChildren = true;
+}
+
+unsigned int MCTS::getChild(unsigned int node, unsigned int edge) {
+    if (edges.child[edge] == NO_NODE) {
+        unsigned int child = tree.allocate(1);
+
+        tree[child].parent = node;
+        tree[child].edge = edge;
+        tree[child].action = edges.action[edge];
+        edges.child[edge] = child;
+    }
+
+    return edges.child[edge];
+}
+
+MCTSNode &MCTS::getRoot() {
+    return tree[rootIndex];
+}
+
+unsigned int MCTS::getBestEdge(unsigned int node) {
+    unsigned int best = NO_NODE;
+    bool bestLoses = true;
+
+    for (unsigned int i = tree[node].firstEdge; i < tree[node].firstEdge + tree[node].numEdges && tree[node].hasChildren; i++) {
+        unsigned char proven = edges.proven[i];
+
+        if (proven == PROVEN_WIN) {
+            return i;
+        }
+
+        bool loses = proven == PROVEN_LOSS;
+
+        if (best == NO_NODE || (bestLoses && !loses) || (bestLoses == loses && getEdgeVisits(i) > getEdgeVisits(best))) {
+            best = i;
+            bestLoses = loses;
+        }
+    }
+
+    return best;
+}
+
+bool MCTS::isMoveDecided(int remainingSims) {
+    MCTSNode &root = getRoot();
+    unsigned int best = getBestEdge(rootIndex);
+
+    if (best == NO_NODE) {
+        return false;
+    }
+
+    if (edges.proven[best] == PROVEN_WIN) {
+        return true;
+    }
+
+    unsigned int runnerUp = 0;
+    for (unsigned int i = root.firstEdge; i < root.firstEdge + root.numEdges; i++) {
+        if (i != best) {
+            runnerUp = max(runnerUp, getEdgeVisits(i));
+        }
+    }
+
+    return runnerUp + max(remainingSims, 0) < getEdgeVisits(best);
+}
+
+unsigned int MCTS::getEdgeVisits(unsigned int edge) {
+    return edges.n[edge];
+}
+
+unsigned int MCTS::getVisits(unsigned int node) {
+    return edges.n[tree[node].edge];
+}
+
+float MCTS::getValueSum(unsigned int node) {
+    return edges.w[tree[node].edge];
+}
+
+unsigned char MCTS::getProven(unsigned int node) {
+    return edges.proven[tree[node].edge];
+}
+
+size_t MCTS::memoryUsage() {
+    return tree.memoryUsage() + edges.memoryUsage() + spareTree.memoryUsage() + spareEdges.memoryUsage();
+}
+
+size_t MCTS::treeSize() {
+    return tree.size() + edges.size();
+}
+
+void MCTS::enforceNodeBudget(int numLeaves) {
+    if (nodeBudget == 0 || freezeOnBudget || treeSize() + numLeaves * EXPANSION_SIZE <= nodeBudget) {
+        return;
+    }
+
+    pruneTree(nodeBudget * PRUNE_TARGET_FRACTION);
+    prunes++;
 }
 
-void MCTS::backpropagate(Node *finalNode, float result) {
-    while (currentNode != NULL) {
-        if (currentNode->board.getToMove() == 1) {
-            currentNode->w += result * -1;
+void MCTS::pruneTree(size_t targetSize) {
+    MCTSNode &root = getRoot();
+    size_t size = 1 + root.numEdges;
+
+    // Size of each node with its edges, by visits
+    vector<pair<unsigned int, unsigned int>> nodes;
+    nodes.reserve(tree.size());
+
+    for (unsigned int node = 0; node < tree.size(); node++) {
+        if (node != rootIndex) {
+            nodes.push_back({getVisits(node), 1 + tree[node].numEdges});
+        }
+    }
+
+    sort(nodes.begin(), nodes.end(), greater<pair<unsigned int, unsigned int>>());
+
+    // A child never has more visits than its parent, so keeping every node
+    // above a visit count keeps a connected tree
+    unsigned int minVisits = 0;
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (size + nodes[i].second > targetSize) {
+            minVisits = nodes[i].first + 1;
+            break;
+        }
+
+        size += nodes[i].second;
+    }
+
+    if (minVisits > 0) {
+        compactTree(rootIndex, 1, minVisits);
+    }
+}
+
+void MCTS::releaseMemory() {
+    tree.release();
+    edges.release();
+    spareTree.release();
+    spareEdges.release();
+    pendingLeaves.clear();
+    pendingLeaves.shrink_to_fit();
+}
+
+void MCTS::backpropagate(unsigned int finalNode, float result) {
+    // The player to move alternates on the way back up the tree
+    int toMove = currentPosition.getToMove();
+    unsigned int node = finalNode;
+
+    while (node != NO_NODE) {
+        if (toMove == 1) {
+            edges.w[tree[node].edge] += result * -1;
         }
 
         else {
-            currentNode->w += result;
+            edges.w[tree[node].edge] += result;
+        }
+
+        toMove = (toMove == 1) ? 2 : 1;
+        node = tree[node].parent;
+    }
+}
+
+void MCTS::proveNode(unsigned int node, int status, int toMove) {
+    int mover = (toMove == 1) ? 2 : 1;
+
+    if (status == 3) {
+        edges.proven[tree[node].edge] = PROVEN_DRAW;
+    } else {
+        edges.proven[tree[node].edge] = (status == mover) ? PROVEN_WIN : PROVEN_LOSS;
+    }
+
+    for (node = tree[node].parent; node != NO_NODE && getProven(node) == PROVEN_NONE; node = tree[node].parent) {
+        edges.proven[tree[node].edge] = getProvenResult(node);
+
+        if (getProven(node) == PROVEN_NONE) {
+            break;
         }
+    }
+}
 
-        currentNode = currentNode->parent;
+unsigned char MCTS::getProvenResult(unsigned int node) {
+    if (!tree[node].hasChildren) {
+        return PROVEN_NONE;
+    }
+
+    bool allProven = true, anyDraw = false;
+
+    for (unsigned int i = tree[node].firstEdge; i < tree[node].firstEdge + tree[node].numEdges; i++) {
+        if (edges.proven[i] == PROVEN_NONE) {
+            allProven = false;
+            continue;
+        }
+
+        // The player to move has a winning reply
+        if (edges.proven[i] == PROVEN_WIN) {
+            return PROVEN_LOSS;
+        }
+
+        anyDraw = anyDraw || edges.proven[i] == PROVEN_DRAW;
+    }
+
+    if (!allProven) {
+        return PROVEN_NONE;
+    }
+
+    return (anyDraw) ? PROVEN_DRAW : PROVEN_WIN;
+}
+
+void MCTS::addVirtualLoss(unsigned int node, float value) {
+    while (node != NO_NODE) {
+        edges.w[tree[node].edge] += value;
+        node = tree[node].parent;
     }
 }
 
 board2D MCTS::searchPreNN() {
+    collided = false;
+
+    // Leaves selected before this one are still in the tree
+    if (pendingLeaves.empty()) {
+        enforceNodeBudget(1);
+    }
+
     // Select a node
-    currentNode = &rootNode;
-    Node *bestAction;
-    Node *child;
+    currentNode = rootIndex;
+    currentPosition = rootPosition;
 
-    currentNode->addChildren();
-    currentNode->n++;
+    addChildren(currentNode, currentPosition);
+    edges.n[tree[currentNode].edge]++;
 
-    float bestUCB = -1 * numeric_limits<float>::max();
-    float u, q, v;
+    int status;
 
-    int status, i;
+    // The Gumbel candidates are sampled from the priors, so the root is evaluated first
+    if (gumbelRoot && gumbelSims > 0 && !rootHasPriors() && !tree[currentNode].pending && getProven(currentNode) == PROVEN_NONE) {
+        evaluationNeeded = true;
+        return currentPosition.get2DCanonicalBoard();
+    }
 
     // Search until an unexplored node is found
-    while (currentNode->hasChildren) {
-
-        // Pick the action with the highest upper confidence bound
-        bestUCB = -1 * numeric_limits<float>::max();
-        for (Node &child : currentNode->children) {
-            if (child.n > 0) {
-                u = (child.w / child.n) + cpuct * child.p * (sqrt(currentNode->n) / (1 + child.n));
-            }
-            else {
-                // Always explore an unexplored node
-                bestAction = &child;
-                break;
-            }
+    while (tree[currentNode].hasChildren && !tree[currentNode].pending && getProven(currentNode) == PROVEN_NONE) {
+        MCTSNode &parent = tree[currentNode];
+        int bestOffset;
+
+        // Pick the action with the highest upper confidence bound, proven subtrees have nothing left to search
+        if (gumbelRoot && gumbelSims > 0 && currentNode == rootIndex) {
+            bestOffset = selectGumbelEdge() - parent.firstEdge;
+        } else {
+            float scale = cpuct * sqrtf(getVisits(currentNode));
+            bestOffset = selectPUCT(edges, parent.firstEdge, parent.numEdges, scale);
+        }
 
-            if (u > bestUCB) {
-                bestUCB = u;
-                bestAction = &child;
-            }
+        // Every child is proven, so the node is too
+        if (bestOffset == -1) {
+            edges.proven[parent.edge] = getProvenResult(currentNode);
+            break;
         }
 
-        currentNode = bestAction;
-        currentNode->n++;
+        currentNode = getChild(currentNode, parent.firstEdge + bestOffset);
+        edges.n[tree[currentNode].edge]++;
+
+        int action = tree[currentNode].action;
+        currentPosition.move(action / 9, action % 9);
 
 
-        status = currentNode->board.getStatus();
+        status = currentPosition.getStatus();
 
         // If the game has ended, backpropagate the results and mark the board as visited
         if (status != 0) {
+            proveNode(currentNode, status, currentPosition.getToMove());
+
             if (status == 1) {
                 backpropagate(currentNode, 1);
             }
@@ -134,23 +525,75 @@ board2D MCTS::searchPreNN() {
 
     }
 
-    // A neural network evaluation is needed
-    currentNode->addChildren();
+    // A proven root, a proven root child forced by Gumbel selection or a node whose children were all proven,
+    // PUCT never picks a proven child. Nothing below it is left to expand, so its result is backed up again
+    if (getProven(currentNode) != PROVEN_NONE) {
+        int mover = (currentPosition.getToMove() == 1) ? 2 : 1;
+        float moverResult = (getProven(currentNode) == PROVEN_WIN) ? 1 : ((getProven(currentNode) == PROVEN_LOSS) ? -1 : 0);
+
+        backpropagate(currentNode, (mover == 1) ? moverResult : -moverResult);
+
+        evaluationNeeded = false;
+        return board2D();
+    }
+
+    // The leaf is already waiting for an evaluation, so this selection is undone
+    if (tree[currentNode].pending) {
+        for (unsigned int node = currentNode; node != NO_NODE; node = tree[node].parent) {
+            edges.n[tree[node].edge]--;
+        }
+
+        collided = true;
+        evaluationNeeded = false;
+        return board2D();
+    }
+
+    // Solved endgames are backed up exactly instead of asking the NN
+    if (countRemainingSpots(currentPosition) <= solverSpots) {
+        int solved = getEndgameSolver().solve(currentPosition);
+
+        if (solved != 0) {
+            proveNode(currentNode, solved, currentPosition.getToMove());
+
+            if (solved == 1) {
+                backpropagate(currentNode, 1);
+            }
+
+            else if (solved == 2) {
+                backpropagate(currentNode, -1);
+            }
+
+            else {
+                backpropagate(currentNode, 0);
+            }
+
+            evaluationNeeded = false;
+            return board2D();
+        }
+    }
+
+    // A neural network evaluation is needed. Every edge can still get a node, so a tree
+    // that could outgrow its budget that way is frozen and evaluates the leaf without expanding it
+    if (!freezeOnBudget || nodeBudget == 0 || 2 * (edges.size() + EXPANSION_SIZE) <= nodeBudget) {
+        addChildren(currentNode, currentPosition);
+    }
 
     evaluationNeeded = true;
-    return currentNode->board.get2DCanonicalBoard();
+    return currentPosition.get2DCanonicalBoard();
 }
 
 void MCTS::searchPostNN(vector<float> policy, float v) {
-    int validAction, index, i;
+    int validAction;
     float totalValidMoves = 0;
     int numValidMoves = 0;
-    Node *child;
+
+    MCTSNode &node = tree[currentNode];
+    unsigned int lastEdge = node.firstEdge + node.numEdges;
 
     // Save policy value
     // Normalize policy values based on which moves are valid
-    for (Node &child : currentNode->children) {
-        validAction = child.board.previousMove.board * 9 + child.board.previousMove.piece;
+    for (unsigned int i = node.firstEdge; i < lastEdge; i++) {
+        validAction = edges.action[i];
 
         totalValidMoves += policy[validAction];
         numValidMoves++;
@@ -158,15 +601,14 @@ void MCTS::searchPostNN(vector<float> policy, float v) {
 
     if (totalValidMoves > 0) {
         // Renormalize the values of all valid moves
-        for (Node &child: currentNode->children) {
-            validAction = child.board.previousMove.board * 9 + child.board.previousMove.piece;
-            child.p = policy[validAction] / totalValidMoves;
+        for (unsigned int i = node.firstEdge; i < lastEdge; i++) {
+            validAction = edges.action[i];
+            edges.p[i] = policy[validAction] / totalValidMoves;
         }
     } else {
         // All valid moves were masked, doing a workaround
-        for (Node &child: currentNode->children) {
-            validAction = child.board.previousMove.board * 9 + child.board.previousMove.piece;
-            child.p = 1 / numValidMoves;
+        for (unsigned int i = node.firstEdge; i < lastEdge; i++) {
+            edges.p[i] = 1.0 / numValidMoves;
             cout << "Warning :: All valid moves masked, all valued equal.\n";
         }
     }
@@ -174,28 +616,296 @@ void MCTS::searchPostNN(vector<float> policy, float v) {
     backpropagate(currentNode, v);
 }
 
+vector<board2D> MCTS::searchPreNN(int numLeaves) {
+    vector<board2D> boards;
+    pendingLeaves.clear();
+
+    enforceNodeBudget(numLeaves);
+
+    for (int i = 0; i < numLeaves; i++) {
+        board2D board = searchPreNN();
+
+        if (collided) {
+            break;
+        }
+
+        if (!evaluationNeeded) {
+            continue;
+        }
+
+        // A single leaf is backed up before the next selection, so it needs no virtual loss
+        if (numLeaves > 1) {
+            tree[currentNode].pending = true;
+            addVirtualLoss(currentNode, -virtualLoss);
+        }
+
+        pendingLeaves.push_back({currentNode, currentPosition});
+        boards.push_back(board);
+    }
+
+    evaluationNeeded = boards.size() > 0;
+    return boards;
+}
+
+void MCTS::searchPostNN(vector<vector<float>> policies, vector<float> values) {
+    bool virtualLossAdded = pendingLeaves.size() > 0 && tree[pendingLeaves[0].node].pending;
+
+    for (size_t i = 0; i < pendingLeaves.size(); i++) {
+        currentNode = pendingLeaves[i].node;
+        currentPosition = pendingLeaves[i].position;
+
+        if (virtualLossAdded) {
+            tree[currentNode].pending = false;
+            addVirtualLoss(currentNode, virtualLoss);
+        }
+
+        searchPostNN(policies[i], values[i]);
+    }
+
+    pendingLeaves.clear();
+    evaluationNeeded = false;
+}
+
+void MCTS::startGumbelSearch(int sims) {
+    // A root that was reset after an action has no edges yet to sample noise for
+    addChildren(rootIndex, rootPosition);
+
+    MCTSNode &root = getRoot();
+
+    gumbelSims = max(sims, 1);
+    gumbelStartVisits = getVisits(rootIndex);
+    gumbelCandidates.clear();
+    gumbelNoise.resize(root.numEdges);
+
+    // Gumbel(0, 1) samples, -log(-log(u))
+    uniform_real_distribution<float> uniform(numeric_limits<float>::min(), 1);
+
+    for (int i = 0; i < root.numEdges; i++) {
+        gumbelNoise[i] = -logf(-logf(uniform(gen)));
+    }
+}
+
+bool MCTS::rootHasPriors() {
+    MCTSNode &root = getRoot();
+
+    for (unsigned int i = root.firstEdge; i < root.firstEdge + root.numEdges; i++) {
+        if (edges.p[i] > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+float MCTS::getMixedValue() {
+    MCTSNode &root = getRoot();
+
+    // The root's own value is for the player who moved into it
+    float value = (getVisits(rootIndex) > 0) ? -getValueSum(rootIndex) / getVisits(rootIndex) : 0;
+    float visits = 0, visitedPrior = 0, visitedValue = 0;
+
+    for (unsigned int i = root.firstEdge; i < root.firstEdge + root.numEdges; i++) {
+        if (edges.n[i] > 0) {
+            visits += edges.n[i];
+            visitedPrior += edges.p[i];
+            visitedValue += edges.p[i] * edges.w[i] / edges.n[i];
+        }
+    }
+
+    if (visitedPrior <= 0) {
+        return value;
+    }
+
+    return (value + visits * visitedValue / visitedPrior) / (1 + visits);
+}
+
+float MCTS::getCompletedQ(unsigned int edge, float mixedValue) {
+    if (edges.proven[edge] != PROVEN_NONE) {
+        return (edges.proven[edge] == PROVEN_WIN) ? 1 : ((edges.proven[edge] == PROVEN_LOSS) ? -1 : 0);
+    }
+
+    return (edges.n[edge] > 0) ? edges.w[edge] / edges.n[edge] : mixedValue;
+}
+
+float MCTS::getGumbelScore(unsigned int edge, bool withNoise, float mixedValue) {
+    MCTSNode &root = getRoot();
+    unsigned int maxVisits = 0;
+
+    for (unsigned int i = root.firstEdge; i < root.firstEdge + root.numEdges; i++) {
+        maxVisits = max(maxVisits, edges.n[i]);
+    }
+
+    // Values from -1 to 1 are scaled to 0 to 1 before sigma
+    float sigma = (GUMBEL_C_VISIT + maxVisits) * GUMBEL_C_SCALE * (getCompletedQ(edge, mixedValue) + 1) / 2;
+    float logit = logf(max(edges.p[edge], numeric_limits<float>::min()));
+    float noise = (withNoise && edge - root.firstEdge < gumbelNoise.size()) ? gumbelNoise[edge - root.firstEdge] : 0;
+
+    return noise + logit + sigma;
+}
+
+unsigned int MCTS::selectGumbelEdge() {
+    MCTSNode &root = getRoot();
+    float mixedValue = getMixedValue();
+
+    // Sims the search has left, this one included
+    int remaining = max(gumbelSims - (int) (getVisits(rootIndex) - 1 - gumbelStartVisits), 1);
+
+    // Visits each candidate gets in a phase, spreading the sims left evenly over the phases
+    auto phaseVisits = [&remaining](int candidates) {
+        int phases = (int) ceilf(log2f(candidates));
+        return (unsigned int) max(remaining / max(phases * candidates, 1), 1);
+    };
+
+    // The top k of g + logit
+    if (gumbelCandidates.empty()) {
+        for (int i = 0; i < root.numEdges; i++) {
+            gumbelCandidates.push_back(i);
+        }
+
+        sort(gumbelCandidates.begin(), gumbelCandidates.end(), [&](unsigned int a, unsigned int b) {
+            return gumbelNoise[a] + logf(max(edges.p[root.firstEdge + a], numeric_limits<float>::min()))
+                 > gumbelNoise[b] + logf(max(edges.p[root.firstEdge + b], numeric_limits<float>::min()));
+        });
+
+        gumbelCandidates.resize(min((int) gumbelCandidates.size(), max(gumbelTopK, 1)));
+        gumbelTarget = phaseVisits(gumbelCandidates.size());
+    }
+
+    while (gumbelCandidates.size() > 1) {
+        unsigned int best = NO_NODE;
+
+        for (unsigned int offset : gumbelCandidates) {
+            unsigned int edge = root.firstEdge + offset;
+
+            if (edges.n[edge] < gumbelTarget && (best == NO_NODE || edges.n[edge] < edges.n[best])) {
+                best = edge;
+            }
+        }
+
+        if (best != NO_NODE) {
+            return best;
+        }
+
+        // The phase is over, the better half of the candidates is kept
+        sort(gumbelCandidates.begin(), gumbelCandidates.end(), [&](unsigned int a, unsigned int b) {
+            return getGumbelScore(root.firstEdge + a, true, mixedValue) > getGumbelScore(root.firstEdge + b, true, mixedValue);
+        });
+
+        gumbelCandidates.resize((gumbelCandidates.size() + 1) / 2);
+        gumbelTarget += phaseVisits(gumbelCandidates.size());
+    }
+
+    return root.firstEdge + gumbelCandidates[0];
+}
+
+vector<float> MCTS::getImprovedPolicy() {
+    vector<float> result(81, 0);
+
+    MCTSNode &root = getRoot();
+    float mixedValue = getMixedValue();
+    float maxScore = -numeric_limits<float>::infinity();
+    float total = 0;
+
+    for (unsigned int i = root.firstEdge; i < root.firstEdge + root.numEdges && root.hasChildren; i++) {
+        result[edges.action[i]] = getGumbelScore(i, false, mixedValue);
+        maxScore = max(maxScore, result[edges.action[i]]);
+    }
+
+    for (unsigned int i = root.firstEdge; i < root.firstEdge + root.numEdges && root.hasChildren; i++) {
+        result[edges.action[i]] = expf(result[edges.action[i]] - maxScore);
+        total += result[edges.action[i]];
+    }
+
+    for (float &prob : result) {
+        prob = (total > 0) ? prob / total : 0;
+    }
+
+    return result;
+}
+
+int MCTS::getGumbelAction(bool withNoise) {
+    unsigned int best = getBestEdge(rootIndex);
+
+    if (best == NO_NODE) {
+        return -1;
+    }
+
+    // A proven win is always played
+    if (edges.proven[best] == PROVEN_WIN) {
+        return edges.action[best];
+    }
+
+    float mixedValue = getMixedValue();
+    float bestScore = -numeric_limits<float>::infinity();
+
+    for (unsigned int offset : gumbelCandidates) {
+        float score = getGumbelScore(getRoot().firstEdge + offset, withNoise, mixedValue);
+
+        if (score > bestScore) {
+            bestScore = score;
+            best = getRoot().firstEdge + offset;
+        }
+    }
+
+    return edges.action[best];
+}
+
 vector<float> MCTS::getActionProb() {
     vector<float> result(81, 0);
 
+    if (useOpeningBook) {
+        int bookAction = getBookAction();
+        if (bookAction != -1) {
+            result[bookAction] = 1;
+            return result;
+        }
+    }
+
     float totalActionValue = 0;
-    int numValidActions = 0;
     int maxActionValue = 0;
     int maxActionIndex = 0;
-    
-    for (Node &action : rootNode.children) {
-        int actionIndex = action.board.previousMove.board * 9 + action.board.previousMove.piece;
-        numValidActions++;
-        totalActionValue += action.n;
+
+    MCTSNode &root = getRoot();
+    unsigned int lastEdge = root.firstEdge + root.numEdges;
+
+    auto provenLoss = [this](unsigned int edge) {
+        return edges.proven[edge] == PROVEN_LOSS;
+    };
+
+    // A proven win is always played
+    unsigned int bestEdge = getBestEdge(rootIndex);
+    if (bestEdge != NO_NODE && edges.proven[bestEdge] == PROVEN_WIN) {
+        result[edges.action[bestEdge]] = 1;
+        return result;
     }
 
-    for (Node &action : rootNode.children) {
-        float actionValue = action.n / totalActionValue;
-        int actionIndex = action.board.previousMove.board * 9 + action.board.previousMove.piece;
-        result[actionIndex] = actionValue;
+    float totalWithoutLosses = 0;
+
+    for (unsigned int i = root.firstEdge; i < lastEdge && root.hasChildren; i++) {
+        totalActionValue += getEdgeVisits(i);
+
+        if (!provenLoss(i)) {
+            totalWithoutLosses += getEdgeVisits(i);
+        }
+    }
+
+    // Proven losses are left out unless nothing else was visited
+    bool skipLosses = totalWithoutLosses > 0;
+    if (skipLosses) {
+        totalActionValue = totalWithoutLosses;
+    }
+
+    for (unsigned int i = root.firstEdge; i < lastEdge && root.hasChildren; i++) {
+        if (skipLosses && provenLoss(i)) {
+            continue;
+        }
+
+        float actionValue = getEdgeVisits(i) / totalActionValue;
+        result[edges.action[i]] = actionValue;
 
         if (actionValue > maxActionValue) {
             maxActionValue = actionValue;
-            maxActionIndex = actionIndex;
+            maxActionIndex = edges.action[i];
         }
     }
 
@@ -208,31 +918,554 @@ vector<float> MCTS::getActionProb() {
     return result;
 }
 
-void MCTS::takeAction(int actionIndex) {
-    rootNode.addChildren();
-    for (Node &action : rootNode.children) {
-        
-        int newActionIndex = action.board.previousMove.board * 9 + action.board.previousMove.piece;
-        if (actionIndex == newActionIndex) {
-            rootNode = Node(action.board, 0);
-            // TODO: Save tree search in between sims
+int MCTS::getBookAction() {
+    int action;
+
+    if (openingBook.probe(rootPosition, action)) {
+        return action;
+    }
+
+    return -1;
+}
+
+void MCTS::takeAction(int actionIndex, float reuseFraction) {
+    addChildren(rootIndex, rootPosition);
+
+    MCTSNode &root = getRoot();
+    unsigned int lastEdge = root.firstEdge + root.numEdges;
+    unsigned int chosenEdge = NO_NODE;
+
+    for (unsigned int i = root.firstEdge; i < lastEdge && root.hasChildren; i++) {
+        if (edges.action[i] == actionIndex) {
+            chosenEdge = i;
+            break;
+        }
+    }
+
+    if (chosenEdge == NO_NODE) {
+        cout << "Warning :: No valid action was found with index " << actionIndex << '\n';
+        return;
+    }
+
+    rootPosition.move(actionIndex / 9, actionIndex % 9);
+
+    gumbelSims = 0;
+    gumbelCandidates.clear();
+
+    unsigned int chosen = edges.child[chosenEdge];
+
+    // A leaf proven by the solver is dropped too, its visits never reached its children
+    if (reuseFraction <= 0 || chosen == NO_NODE || edges.n[chosenEdge] == 0 || !tree[chosen].hasChildren) {
+        resetTree();
+        return;
+    }
+
+    compactTree(chosen, reuseFraction, 0);
+}
+
+void MCTS::compactTree(unsigned int node, float reuseFraction, unsigned int minVisits) {
+    copyTree(node, reuseFraction, minVisits, 0);
+
+    tree.swap(spareTree);
+    edges.swap(spareEdges);
+    spareTree.reset();
+    spareEdges.reset();
+    rootIndex = 0;
+}
+
+void MCTS::copyTree(unsigned int node, float reuseFraction, unsigned int minVisits, int maxDepth) {
+    spareTree.reset();
+    spareEdges.reset();
+
+    // Copies an edge, scaling its visits while leaving its mean value unchanged
+    auto copyEdge = [this, reuseFraction](unsigned int index, unsigned int oldIndex) {
+        spareEdges.copy(index, edges, oldIndex);
+
+        if (reuseFraction >= 1) {
             return;
         }
+
+        unsigned int n = spareEdges.n[index] * reuseFraction;
+        spareEdges.w[index] = (n > 0) ? spareEdges.w[index] * n / spareEdges.n[index] : 0;
+        spareEdges.n[index] = n;
+    };
+
+    unsigned int newRoot = spareTree.allocate(1);
+
+    spareTree[newRoot] = tree[node];
+    spareTree[newRoot].parent = NO_NODE;
+    spareTree[newRoot].edge = spareEdges.allocate(1);
+    copyEdge(spareTree[newRoot].edge, tree[node].edge);
+    spareEdges.child[spareTree[newRoot].edge] = newRoot;
+
+    // Nodes before levelEnd are depth moves below the new root
+    unsigned int levelEnd = newRoot + 1;
+    int depth = 0;
+
+    // Copy the subtree breadth first. Copied nodes still point at their edges in
+    // the old tree until they are reached, so each block of edges stays together
+    for (unsigned int copied = newRoot; copied < spareTree.size(); copied++) {
+        if (copied == levelEnd) {
+            levelEnd = spareTree.size();
+            depth++;
+        }
+
+        if (!spareTree[copied].hasChildren) {
+            continue;
+        }
+
+        bool copyChildren = maxDepth <= 0 || depth < maxDepth;
+
+        unsigned int oldFirstEdge = spareTree[copied].firstEdge;
+        int numEdges = spareTree[copied].numEdges;
+        unsigned int firstEdge = spareEdges.allocate(numEdges);
+
+        for (int i = 0; i < numEdges; i++) {
+            unsigned int edge = firstEdge + i;
+            unsigned int oldChild = edges.child[oldFirstEdge + i];
+            copyEdge(edge, oldFirstEdge + i);
+
+            // A pruned child becomes a leaf again, its edge keeps the statistics
+            if (oldChild == NO_NODE || edges.n[oldFirstEdge + i] < minVisits || !copyChildren) {
+                spareEdges.child[edge] = NO_NODE;
+                continue;
+            }
+
+            unsigned int child = spareTree.allocate(1);
+
+            spareTree[child] = tree[oldChild];
+            spareTree[child].parent = copied;
+            spareTree[child].edge = edge;
+            spareEdges.child[edge] = child;
+        }
+
+        spareTree[copied].firstEdge = firstEdge;
+    }
+}
+
+void MCTS::takeAction(int actionIndex) {
+    takeAction(actionIndex, REUSE_FRACTION_DEFAULT);
+}
+
+bool MCTS::saveTree(string filename, int maxDepth, unsigned int minVisits) {
+    if (!pendingLeaves.empty()) {
+        cout << "Warning :: The tree cannot be saved while leaves are waiting for the NN\n";
+        return false;
+    }
+
+    ofstream file(filename, ios::binary | ios::trunc);
+    if (!file) {
+        cout << "Warning :: Could not write tree " << filename << '\n';
+        return false;
+    }
+
+    copyTree(rootIndex, 1, minVisits, maxDepth);
+
+    treeSnapshotHeader header;
+    header.numNodes = spareTree.size();
+    header.numEdges = spareEdges.size();
+
+    for (int b = 0; b < 9; b++) {
+        header.rootBoards[b] = rootPosition.board[b].to_ulong();
+    }
+
+    header.rootInfo = rootPosition.info;
+    header.previousBoard = rootPosition.previousMove.board;
+    header.previousPiece = rootPosition.previousMove.piece;
+
+    file.write((const char *) &header, sizeof(treeSnapshotHeader));
+    file.write((const char *) &spareTree[0], header.numNodes * sizeof(MCTSNode));
+    file.write((const char *) spareEdges.child.data(), header.numEdges * sizeof(unsigned int));
+    file.write((const char *) spareEdges.n.data(), header.numEdges * sizeof(unsigned int));
+    file.write((const char *) spareEdges.w.data(), header.numEdges * sizeof(float));
+    file.write((const char *) spareEdges.p.data(), header.numEdges * sizeof(float));
+    file.write((const char *) spareEdges.proven.data(), header.numEdges);
+    file.write((const char *) spareEdges.action.data(), header.numEdges);
+
+    spareTree.reset();
+    spareEdges.reset();
+
+    return file.good();
+}
+
+bool MCTS::saveTree(string filename) {
+    return saveTree(filename, 0, 0);
+}
+
+/**
+ * Checks that the root position of a snapshot could come from a game: each
+ * spot holds one piece at most, the miniboard results match the pieces,
+ * and the player to move, required board and previous move agree with them.
+ */
+bool isValidSnapshotPosition(const treeSnapshotHeader &header) {
+    GameState stored, rebuilt;
+    int pieces[3] = {0, 0, 0};
+
+    for (int b = 0; b < 9; b++) {
+        if (header.rootBoards[b] >> 20 != 0) {
+            return false;
+        }
+
+        stored.board[b] = bitset<20>(header.rootBoards[b]);
+
+        for (int s = 0; s < 9; s++) {
+            if (stored.board[b][2 * s + 2] && stored.board[b][2 * s + 3]) {
+                return false;
+            }
+
+            int piece = stored.getPosition(b, s);
+            rebuilt.setPosition(b, s, piece);
+            pieces[piece]++;
+        }
+    }
+
+    rebuilt.updateMiniboardStatus();
+
+    for (int b = 0; b < 9; b++) {
+        if (rebuilt.board[b] != stored.board[b]) {
+            return false;
+        }
+    }
+
+    // Only the required board and the player to move are kept in info
+    if ((header.rootInfo & ~0b111111) != 0) {
+        return false;
+    }
+
+    stored.info = header.rootInfo;
+    int requiredBoard = stored.getRequiredBoard();
+    int toMove = stored.getToMove();
+
+    if (requiredBoard > 8 || (requiredBoard != -1 && stored.getBoardStatus(requiredBoard) != 0)) {
+        return false;
+    }
+
+    // Either player may have started, then they take turns
+    if (abs(pieces[1] - pieces[2]) > 1 || (pieces[1] != pieces[2] && pieces[toMove] > pieces[3 - toMove])) {
+        return false;
+    }
+
+    int previousBoard = header.previousBoard, previousPiece = header.previousPiece;
+
+    if (previousBoard == -1 && previousPiece == -1) {
+        return true;
+    }
+
+    if (previousBoard < 0 || previousBoard > 8 || previousPiece < 0 || previousPiece > 8) {
+        return false;
+    }
+
+    // The previous move was made by the other player, and sent this one to its piece's board
+    int expectedBoard = (stored.getBoardStatus(previousPiece) == 0) ? previousPiece : -1;
+
+    return stored.getPosition(previousBoard, previousPiece) == 3 - toMove && requiredBoard == expectedBoard;
+}
+
+/**
+ * Checks that a snapshot's nodes and edges are laid out the way saveTree
+ * writes them, so searching the tree can never follow an index out of the
+ * arenas or around a cycle: every node comes after its parent and is the
+ * child of its own edge, and the nodes' edge blocks follow each other in
+ * node order after the root's edge.
+ */
+bool isValidSnapshotTree(const MCTSNode *nodes, size_t numNodes, const unsigned int *child, const float *w, const float *p,
+                         const unsigned char *proven, const unsigned char *action, size_t numEdges) {
+    if (nodes[0].parent != NO_NODE || nodes[0].edge != 0 || child[0] != 0) {
+        return false;
+    }
+
+    size_t nextEdge = 1;
+
+    for (size_t i = 0; i < numNodes; i++) {
+        const MCTSNode &node = nodes[i];
+
+        if (node.pending || node.numEdges > 81) {
+            return false;
+        }
+
+        if (i > 0) {
+            const MCTSNode &parent = nodes[min((size_t) node.parent, i - 1)];
+
+            if (node.parent >= i || node.edge >= numEdges || child[node.edge] != i || action[node.edge] != node.action
+                || !parent.hasChildren || node.edge < parent.firstEdge || node.edge >= parent.firstEdge + parent.numEdges) {
+                return false;
+            }
+        }
+
+        if (node.hasChildren) {
+            if (node.firstEdge != nextEdge) {
+                return false;
+            }
+
+            nextEdge += node.numEdges;
+        }
+    }
+
+    if (nextEdge != numEdges) {
+        return false;
+    }
+
+    for (size_t i = 0; i < numEdges; i++) {
+        // The child's own check makes sure it points back at this edge
+        if (child[i] != NO_NODE && (child[i] >= numNodes || nodes[child[i]].edge != i)) {
+            return false;
+        }
+
+        if (action[i] >= 81 || proven[i] > PROVEN_DRAW || !isfinite(w[i]) || !isfinite(p[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool MCTS::loadTree(string filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cout << "Warning :: Could not open tree " << filename << '\n';
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(treeSnapshotHeader)) {
+        ::close(fd);
+        cout << "Warning :: Tree " << filename << " is too small\n";
+        return false;
+    }
+
+    void *data = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        cout << "Warning :: Could not map tree " << filename << '\n';
+        return false;
+    }
+
+    const treeSnapshotHeader *header = (const treeSnapshotHeader *) data;
+    size_t numNodes = header->numNodes, numEdges = header->numEdges;
+    size_t expectedSize = sizeof(treeSnapshotHeader) + numNodes * sizeof(MCTSNode) + numEdges * (4 * sizeof(unsigned int) + 2);
+
+    if (header->magic != TREE_SNAPSHOT_MAGIC || header->version != TREE_SNAPSHOT_VERSION || numNodes == 0 || numEdges == 0
+        || (size_t) fileStat.st_size < expectedSize) {
+        munmap(data, fileStat.st_size);
+        cout << "Warning :: " << filename << " is not a valid tree\n";
+        return false;
+    }
+
+    const MCTSNode *nodes = (const MCTSNode *) ((const char *) data + sizeof(treeSnapshotHeader));
+    const unsigned int *child = (const unsigned int *) (nodes + numNodes);
+    const unsigned int *n = child + numEdges;
+    const float *w = (const float *) (n + numEdges);
+    const float *p = w + numEdges;
+    const unsigned char *proven = (const unsigned char *) (p + numEdges);
+    const unsigned char *action = proven + numEdges;
+
+    if (!isValidSnapshotPosition(*header) || !isValidSnapshotTree(nodes, numNodes, child, w, p, proven, action, numEdges)) {
+        munmap(data, fileStat.st_size);
+        cout << "Warning :: " << filename << " is not a valid tree\n";
+        return false;
+    }
+
+    tree.assign(nodes, numNodes);
+    edges.child.assign(child, child + numEdges);
+    edges.n.assign(n, n + numEdges);
+    edges.w.assign(w, w + numEdges);
+    edges.p.assign(p, p + numEdges);
+    edges.proven.assign(proven, proven + numEdges);
+    edges.action.assign(action, action + numEdges);
+
+    for (int b = 0; b < 9; b++) {
+        rootPosition.board[b] = bitset<20>(header->rootBoards[b]);
+    }
+
+    rootPosition.info = header->rootInfo;
+    rootPosition.previousMove.board = header->previousBoard;
+    rootPosition.previousMove.piece = header->previousPiece;
+
+    munmap(data, fileStat.st_size);
+
+    rootIndex = 0;
+    pendingLeaves.clear();
+    gumbelSims = 0;
+    gumbelCandidates.clear();
+
+    addChildren(rootIndex, rootPosition);
+
+    return true;
+}
+
+void staticEvaluation(GameState &position, vector<float> &policy, float &v) {
+    constants c;
+
+    policy.assign(81, 1.0 / 81);
+    v = tanh(evaluate(position, c) / STATIC_EVAL_SCALE);
+}
+
+void staticBatchEvaluation(void * /* context */, vector<GameState> &positions, vector<vector<float>> &policies, vector<float> &values) {
+    policies.resize(positions.size());
+    values.resize(positions.size());
+
+    for (size_t i = 0; i < positions.size(); i++) {
+        staticEvaluation(positions[i], policies[i], values[i]);
+    }
+}
+
+void MCTS::runPlayouts(int playouts, positionEvaluator evaluator, void *context) {
+    vector<GameState> positions(1);
+    vector<vector<float>> policies;
+    vector<float> values;
+
+    for (int i = 0; i < playouts; i++) {
+        searchPreNN();
+
+        if (evaluationNeeded) {
+            positions[0] = currentPosition;
+            evaluator(context, positions, policies, values);
+            searchPostNN(policies[0], values[0]);
+        }
+    }
+}
+
+mctsSearchResult MCTS::search(mctsSearchLimits limits, positionEvaluator evaluator, void *context) {
+    mctsSearchResult result;
+
+    auto start = chrono::steady_clock::now();
+    auto elapsedUs = [&start]() {
+        return (long long) chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    };
+
+    long long timeLimitUs = (long long) limits.timeMs * 1000;
+    unsigned int startVisits = getVisits(rootIndex);
+
+    // A reset root is not expanded yet, one without children after this has no moves
+    addChildren(rootIndex, rootPosition);
+
+    if (gumbelRoot && limits.sims > 0) {
+        startGumbelSearch(limits.sims);
+    }
+
+    vector<GameState> positions;
+    vector<vector<float>> policies;
+    vector<float> values;
+
+    // Timing of the batches at the current size, and of the size before it
+    int leaves = 1, previousLeaves = 1;
+    double previousLeafUs = numeric_limits<double>::infinity();
+    long long sizeUs = 0, sizeLeaves = 0;
+    int sizeBatches = 0;
+    bool adapting = true;
+
+    long long lastBatchUs = 0, totalBatchUs = 0;
+    int lastBatchLeaves = 1;
+
+    while (getProven(rootIndex) == PROVEN_NONE && tree[rootIndex].hasChildren) {
+        long long sims = getVisits(rootIndex) - startVisits;
+
+        if ((limits.sims > 0 && sims >= limits.sims) || (limits.sims <= 0 && limits.timeMs <= 0)) {
+            break;
+        }
+
+        // The next batch is expected to take as long per leaf as the last one
+        if (limits.timeMs > 0 && elapsedUs() + lastBatchUs * leaves / lastBatchLeaves > timeLimitUs) {
+            break;
+        }
+
+        int numLeaves = (limits.sims > 0) ? (int) min((long long) leaves, limits.sims - sims) : leaves;
+        long long batchStart = elapsedUs();
+
+        searchPreNN(numLeaves);
+
+        int evaluated = pendingLeaves.size();
+
+        if (evaluationNeeded) {
+            positions.resize(evaluated);
+
+            for (int i = 0; i < evaluated; i++) {
+                positions[i] = pendingLeaves[i].position;
+            }
+
+            evaluator(context, positions, policies, values);
+            searchPostNN(policies, values);
+        }
+
+        lastBatchUs = elapsedUs() - batchStart;
+        lastBatchLeaves = max(evaluated, 1);
+        totalBatchUs += lastBatchUs;
+        result.batches++;
+
+        if (!adapting) {
+            continue;
+        }
+
+        sizeUs += lastBatchUs;
+        sizeLeaves += lastBatchLeaves;
+        sizeBatches++;
+
+        if (sizeBatches < SEARCH_SAMPLES_PER_SIZE) {
+            continue;
+        }
+
+        double leafUs = (double) sizeUs / sizeLeaves;
+        bool fits = limits.timeMs <= 0 || 2 * sizeUs / sizeBatches <= timeLimitUs * SEARCH_MAX_BATCH_FRACTION;
+
+        if (leafUs < previousLeafUs * SEARCH_MIN_SPEEDUP && fits && leaves * 2 <= SEARCH_MAX_LEAVES) {
+            previousLeaves = leaves;
+            previousLeafUs = leafUs;
+            leaves *= 2;
+        } else {
+            // Bigger batches stopped paying for their virtual losses
+            if (leafUs >= previousLeafUs) {
+                leaves = previousLeaves;
+            }
+
+            adapting = false;
+        }
+
+        sizeUs = 0;
+        sizeLeaves = 0;
+        sizeBatches = 0;
     }
 
-    cout << "Warning :: No valid action was found with index " << actionIndex << '\n';
+    unsigned int best = getBestEdge(rootIndex);
+
+    if (best != NO_NODE) {
+        result.action = (gumbelRoot && gumbelSims > 0) ? getGumbelAction(false) : edges.action[best];
+
+        for (unsigned int i = getRoot().firstEdge; i < getRoot().firstEdge + getRoot().numEdges; i++) {
+            if (edges.action[i] == result.action) {
+                best = i;
+            }
+        }
+
+        result.value = (edges.n[best] > 0) ? edges.w[best] / edges.n[best] : 0;
+    }
+
+    // The line of play follows the most visited edges
+    for (unsigned int edge = best; edge != NO_NODE && getEdgeVisits(edge) > 0 && result.pv.size() < SEARCH_PV_LENGTH; ) {
+        result.pv.push_back(edges.action[edge]);
+        edge = (edges.child[edge] != NO_NODE) ? getBestEdge(edges.child[edge]) : NO_NODE;
+    }
+
+    result.sims = getVisits(rootIndex) - startVisits;
+    result.rootVisits = getVisits(rootIndex);
+    result.elapsedUs = elapsedUs();
+    result.batchUs = (result.batches > 0) ? (float) totalBatchUs / result.batches : 0;
+    result.leavesPerBatch = leaves;
+    result.policy = (gumbelRoot && gumbelSims > 0) ? getImprovedPolicy() : getActionProb();
+
+    return result;
 }
 
 int MCTS::getStatus() {
-    return rootNode.board.getStatus();
+    return rootPosition.getStatus();
 }
 
 void MCTS::displayGame() {
-    rootNode.board.displayGame();
+    rootPosition.displayGame();
 }
 
 string MCTS::gameToString() {
-    return rootNode.board.gameToString();
+    return rootPosition.gameToString();
 }
 
 void MCTS::saveTrainingExample(vector<float> pi, float q) {
@@ -241,7 +1474,7 @@ void MCTS::saveTrainingExample(vector<float> pi, float q) {
      */
 
     trainingExample newPosition;
-    newPosition.canonicalBoard = rootNode.board.getCanonicalBoardBitset();
+    newPosition.canonicalBoard = rootPosition.getCanonicalBoardBitset();
 
     // Save the pi values to the new position
     for (int i = 0; i < 81; i++) {
@@ -253,7 +1486,7 @@ void MCTS::saveTrainingExample(vector<float> pi, float q) {
 
     // Save which player is to move; This will later be multiplied by the result of the game
     // to get the result for the current player
-    if (rootNode.board.getToMove() == 1) {
+    if (rootPosition.getToMove() == 1) {
         newPosition.result = 1;
     } else {
         newPosition.result = -1;
@@ -330,6 +1563,19 @@ vector<trainingExampleVector> getSymmetries(trainingExampleVector position) {
     return result;
 }
 
+float klDivergence(vector<float> &p, vector<float> &q) {
+    float result = 0;
+
+    for (size_t i = 0; i < p.size(); i++) {
+        if (p[i] > 0) {
+            // Actions q never visited are given a small probability instead of 0
+            result += p[i] * log(p[i] / max(q[i], KL_EPSILON));
+        }
+    }
+
+    return result;
+}
+
 vector<vector<int>> getSymmetriesBoard(vector<int> board) {
     /**
      * Gets all of the equivalent position to the given board.
@@ -0,0 +1,147 @@
+#include "NNCache.h"
+#include "GameState.h"
+
+using namespace std;
+
+NNCache::NNCache() : NNCache(NN_CACHE_SIZE_DEFAULT) {}
+
+NNCache::NNCache(int _capacity) {
+    probes = 0;
+    hits = 0;
+    stores = 0;
+    evictions = 0;
+
+    shards = unique_ptr<shard[]>(new shard[NN_CACHE_SHARDS]);
+    resize(_capacity);
+}
+
+NNCache::shard &NNCache::getShard(unsigned long long key) {
+    // The low bits pick the bucket inside the shard's map
+    return shards[(key >> 58) % NN_CACHE_SHARDS];
+}
+
+void NNCache::resize(int _capacity) {
+    capacity = max(_capacity, 0);
+    shardCapacity = (capacity + NN_CACHE_SHARDS - 1) / NN_CACHE_SHARDS;
+
+    for (int i = 0; i < NN_CACHE_SHARDS; i++) {
+        lock_guard<mutex> lock(shards[i].mtx);
+
+        shards[i].entries.clear();
+        shards[i].entries.shrink_to_fit();
+        shards[i].entries.reserve(shardCapacity);
+        shards[i].index.clear();
+        shards[i].index.reserve(shardCapacity);
+        shards[i].hand = 0;
+    }
+}
+
+void NNCache::flush() {
+    for (int i = 0; i < NN_CACHE_SHARDS; i++) {
+        lock_guard<mutex> lock(shards[i].mtx);
+
+        shards[i].entries.clear();
+        shards[i].index.clear();
+        shards[i].hand = 0;
+    }
+}
+
+int NNCache::getCapacity() {
+    return capacity;
+}
+
+bool NNCache::probe(unsigned long long key, int symmetry, vector<float> &policy, float &value) {
+    if (capacity == 0) {
+        return false;
+    }
+
+    probes++;
+
+    shard &s = getShard(key);
+    lock_guard<mutex> lock(s.mtx);
+
+    auto found = s.index.find(key);
+    if (found == s.index.end()) {
+        return false;
+    }
+
+    nnCacheEntry &entry = s.entries[found->second];
+    entry.referenced = true;
+
+    policy.resize(81);
+    for (int action = 0; action < 81; action++) {
+        policy[action] = entry.policy[actionToSymmetry(action, symmetry)];
+    }
+    value = entry.value;
+
+    hits++;
+    return true;
+}
+
+void NNCache::store(unsigned long long key, int symmetry, vector<float> &policy, float value) {
+    if (capacity == 0) {
+        return;
+    }
+
+    shard &s = getShard(key);
+    lock_guard<mutex> lock(s.mtx);
+
+    unsigned int slot;
+    auto found = s.index.find(key);
+
+    if (found != s.index.end()) {
+        slot = found->second;
+    } else if ((int) s.entries.size() < shardCapacity) {
+        slot = s.entries.size();
+        s.entries.push_back(nnCacheEntry());
+        s.index[key] = slot;
+    } else {
+        // Clock: entries used since the hand last passed get another chance
+        while (s.entries[s.hand].referenced) {
+            s.entries[s.hand].referenced = false;
+            s.hand = (s.hand + 1) % s.entries.size();
+        }
+
+        slot = s.hand;
+        s.hand = (s.hand + 1) % s.entries.size();
+
+        s.index.erase(s.entries[slot].key);
+        s.index[key] = slot;
+        evictions++;
+    }
+
+    nnCacheEntry &entry = s.entries[slot];
+    entry.key = key;
+    entry.value = value;
+    entry.referenced = false;
+
+    for (int action = 0; action < 81; action++) {
+        entry.policy[actionToSymmetry(action, symmetry)] = policy[action];
+    }
+
+    stores++;
+}
+
+nnCacheStats NNCache::getStats() {
+    nnCacheStats stats;
+
+    stats.probes = probes;
+    stats.hits = hits;
+    stats.stores = stores;
+    stats.evictions = evictions;
+
+    return stats;
+}
+
+void NNCache::resetStats() {
+    probes = 0;
+    hits = 0;
+    stores = 0;
+    evictions = 0;
+}
+
+void getCacheKey(GameState &position, unsigned long long &key, int &symmetry) {
+    // The smallest hash over the 8 symmetries, with the side to move and the required board hashed in.
+    // Training data dedup orients boards with findCanonicalRotation instead, so the keys are unrelated.
+    key = position.canonicalHash(symmetry);
+}
@@ -0,0 +1,178 @@
+#include "OpeningBook.h"
+#include "GameState.h"
+#include <algorithm>
+#include <fstream>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+OpeningBook openingBook;
+
+OpeningBook::OpeningBook() {
+}
+
+OpeningBook::~OpeningBook() {
+    close();
+}
+
+bool OpeningBook::open(string filename) {
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cout << "Warning :: Could not open opening book " << filename << '\n';
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(bookHeader)) {
+        ::close(fd);
+        cout << "Warning :: Opening book " << filename << " is too small\n";
+        return false;
+    }
+
+    void *data = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping stays valid after the file is closed
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        cout << "Warning :: Could not map opening book " << filename << '\n';
+        return false;
+    }
+
+    const bookHeader *header = (const bookHeader *) data;
+    size_t expectedSize = sizeof(bookHeader) + (size_t) header->numEntries * sizeof(bookEntry);
+
+    if (header->magic != OPENING_BOOK_MAGIC || header->version != OPENING_BOOK_VERSION || (size_t) fileStat.st_size < expectedSize) {
+        munmap(data, fileStat.st_size);
+        cout << "Warning :: " << filename << " is not a valid opening book\n";
+        return false;
+    }
+
+    mapped = data;
+    mappedSize = fileStat.st_size;
+    numEntries = header->numEntries;
+    entries = (const bookEntry *) ((const char *) data + sizeof(bookHeader));
+
+    return true;
+}
+
+void OpeningBook::close() {
+    if (mapped != nullptr) {
+        munmap(mapped, mappedSize);
+    }
+
+    mapped = nullptr;
+    mappedSize = 0;
+    entries = nullptr;
+    numEntries = 0;
+}
+
+bool OpeningBook::isOpen() {
+    return mapped != nullptr;
+}
+
+unsigned int OpeningBook::size() {
+    return numEntries;
+}
+
+bool OpeningBook::probe(GameState position, int &action) {
+    bookEntry entry;
+    return probe(position, action, entry);
+}
+
+bool OpeningBook::probe(GameState position, int &action, bookEntry &entry) {
+    if (numEntries == 0) {
+        return false;
+    }
+
+    int symmetry = position.getCanonicalSymmetry();
+    unsigned long long key = position.getSymmetry(symmetry).hash();
+
+    // Binary search the sorted entries
+    const bookEntry *end = entries + numEntries;
+    const bookEntry *found = lower_bound(entries, end, key, [](const bookEntry &e, unsigned long long k) {
+        return e.key < k;
+    });
+
+    if (found == end || found->key != key) {
+        return false;
+    }
+
+    entry = *found;
+    action = actionFromSymmetry(found->action, symmetry);
+
+    // Guard against hash collisions producing an illegal move
+    if (!position.isValidMove(action / 9, action % 9) || position.getBoardStatus(action / 9) != 0) {
+        return false;
+    }
+
+    return true;
+}
+
+bool loadOpeningBook(string filename) {
+    return openingBook.open(filename);
+}
+
+bool writeOpeningBook(string filename, vector<bookEntry> entries, int maxPly) {
+    sort(entries.begin(), entries.end(), [](const bookEntry &a, const bookEntry &b) {
+        return a.key < b.key;
+    });
+
+    ofstream file(filename, ios::binary | ios::trunc);
+    if (!file) {
+        cout << "Warning :: Could not write opening book " << filename << '\n';
+        return false;
+    }
+
+    bookHeader header;
+    header.numEntries = entries.size();
+    header.maxPly = maxPly;
+
+    file.write((const char *) &header, sizeof(bookHeader));
+    file.write((const char *) entries.data(), entries.size() * sizeof(bookEntry));
+
+    return file.good();
+}
+
+vector<GameState> getBookPositions(GameState position, int plies) {
+    vector<GameState> result;
+    vector<GameState> currentPly;
+    unordered_set<unsigned long long> seen;
+
+    currentPly.push_back(position.getSymmetry(position.getCanonicalSymmetry()));
+    seen.insert(currentPly[0].hash());
+
+    for (int ply = 0; ply <= plies; ply++) {
+        vector<GameState> nextPly;
+
+        for (GameState &current : currentPly) {
+            if (current.getStatus() != 0) {
+                continue;
+            }
+
+            result.push_back(current);
+
+            // Positions on the last ply are not expanded
+            if (ply == plies) {
+                continue;
+            }
+
+            for (GameState next : current.allPossibleMoves()) {
+                GameState canonical = next.getSymmetry(next.getCanonicalSymmetry());
+                if (seen.insert(canonical.hash()).second) {
+                    nextPly.push_back(canonical);
+                }
+            }
+        }
+
+        currentPly = nextPly;
+    }
+
+    return result;
+}
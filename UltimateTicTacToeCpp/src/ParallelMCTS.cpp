@@ -0,0 +1,382 @@
+#include "ParallelMCTS.h"
+#include "GameState.h"
+#include "MonteCarlo.h"
+#include "ProofNumber.h"
+#include <chrono>
+#include <limits>
+#include <math.h>
+#include <thread>
+
+using namespace std;
+
+void atomicAdd(atomic<float> &value, float amount) {
+    float current = value.load(memory_order_relaxed);
+
+    while (!value.compare_exchange_weak(current, current + amount, memory_order_relaxed)) {}
+}
+
+ParallelMCTS::ParallelMCTS() : ParallelMCTS(PARALLEL_THREADS_DEFAULT, 1, PARALLEL_MAX_NODES_DEFAULT) {}
+
+ParallelMCTS::ParallelMCTS(int _numThreads, float _cpuct, int maxNodes) : nodes(maxNodes), edges((size_t) maxNodes * PARALLEL_EDGES_PER_NODE) {
+    numThreads = _numThreads;
+    batchSize = _numThreads;
+    cpuct = _cpuct;
+
+    numNodes = 0;
+    numEdges = 0;
+    playouts = 0;
+    stopFlag = false;
+
+    rootIndex = allocateNode(NO_NODE, 0);
+    currentBatch = make_shared<evaluationBatch>();
+}
+
+void ParallelMCTS::setEvaluator(positionEvaluator _evaluator, void *context) {
+    evaluator = _evaluator;
+    evaluatorContext = context;
+}
+
+unsigned int ParallelMCTS::allocateNode(unsigned int parent, unsigned char action) {
+    unsigned int index = numNodes.fetch_add(1);
+
+    if (index >= nodes.size()) {
+        return NO_NODE;
+    }
+
+    parallelNode &node = nodes[index];
+    node.parent = parent;
+    node.n.store(0, memory_order_relaxed);
+    node.w.store(0, memory_order_relaxed);
+    node.firstEdge = NO_NODE;
+    node.action = action;
+    node.numEdges = 0;
+    node.state.store(PARALLEL_UNEXPANDED, memory_order_relaxed);
+
+    return index;
+}
+
+void ParallelMCTS::addVisit(unsigned int node) {
+    nodes[node].n.fetch_add(1, memory_order_relaxed);
+    atomicAdd(nodes[node].w, -virtualLoss);
+}
+
+void ParallelMCTS::undoVisits(unsigned int node) {
+    while (node != NO_NODE) {
+        nodes[node].n.fetch_sub(1, memory_order_relaxed);
+        atomicAdd(nodes[node].w, virtualLoss);
+
+        node = nodes[node].parent;
+    }
+}
+
+void ParallelMCTS::backpropagate(unsigned int node, GameState &position, float result) {
+    // Same perspective as MCTS::backpropagate, also removing the virtual loss
+    int toMove = position.getToMove();
+
+    while (node != NO_NODE) {
+        atomicAdd(nodes[node].w, ((toMove == 1) ? -result : result) + virtualLoss);
+
+        toMove = (toMove == 1) ? 2 : 1;
+        node = nodes[node].parent;
+    }
+}
+
+void ParallelMCTS::evaluateBatch(shared_ptr<evaluationBatch> batch, unique_lock<mutex> &lock) {
+    // New leaves go into the next batch while this one is evaluated
+    currentBatch = make_shared<evaluationBatch>();
+    lock.unlock();
+
+    evaluatorMtx.lock();
+    evaluator(evaluatorContext, batch->positions, batch->policies, batch->values);
+    evaluatorMtx.unlock();
+
+    size_t count = batch->positions.size();
+    bool complete = batch->policies.size() == count && batch->values.size() == count;
+
+    for (size_t i = 0; i < batch->policies.size() && complete; i++) {
+        complete = batch->policies[i].size() == 81;
+    }
+
+    // The leaves already waiting get a uniform policy so their playouts can finish
+    if (!complete) {
+        cout << "Warning :: The evaluator did not give a policy and value for every position, stopping the search\n";
+
+        batch->policies.assign(count, vector<float>(81, 1.0 / 81));
+        batch->values.assign(count, 0);
+        stopFlag = true;
+    }
+
+    lock.lock();
+    batch->done = true;
+    batchCv.notify_all();
+}
+
+void ParallelMCTS::evaluate(GameState &position, vector<float> &policy, float &v) {
+    unique_lock<mutex> lock(batchMtx);
+
+    shared_ptr<evaluationBatch> batch = currentBatch;
+    size_t index = batch->positions.size();
+    batch->positions.push_back(position);
+
+    if ((int) batch->positions.size() >= batchSize) {
+        evaluateBatch(batch, lock);
+    } else if (!batchCv.wait_for(lock, chrono::microseconds(PARALLEL_BATCH_WAIT_US), [&]() { return batch->done; })) {
+        // The batch did not fill in time, so it is evaluated as it is
+        if (batch == currentBatch) {
+            evaluateBatch(batch, lock);
+        } else {
+            batchCv.wait(lock, [&]() { return batch->done; });
+        }
+    }
+
+    if (index >= batch->policies.size() || index >= batch->values.size()) {
+        policy.assign(81, 1.0 / 81);
+        v = 0;
+        return;
+    }
+
+    policy = batch->policies[index];
+    v = batch->values[index];
+}
+
+bool ParallelMCTS::playout() {
+    unsigned int node = rootIndex;
+    GameState position = rootPosition;
+    int status;
+
+    addVisit(node);
+
+    // Select a leaf
+    while (nodes[node].state.load(memory_order_acquire) == PARALLEL_EXPANDED) {
+        parallelNode &parent = nodes[node];
+        unsigned int lastEdge = parent.firstEdge + parent.numEdges;
+        float parentVisits = sqrt(parent.n.load(memory_order_relaxed));
+
+        unsigned int bestEdge = parent.firstEdge;
+        float bestUCB = -1 * numeric_limits<float>::max();
+
+        for (unsigned int i = parent.firstEdge; i < lastEdge; i++) {
+            unsigned int child = edges[i].child.load(memory_order_acquire);
+            unsigned int n = (child == NO_NODE) ? 0 : nodes[child].n.load(memory_order_relaxed);
+
+            // Always explore an unexplored node
+            if (n == 0) {
+                bestEdge = i;
+                break;
+            }
+
+            float u = (nodes[child].w.load(memory_order_relaxed) / n) + cpuct * edges[i].p * (parentVisits / (1 + n));
+
+            if (u > bestUCB) {
+                bestUCB = u;
+                bestEdge = i;
+            }
+        }
+
+        unsigned int child = edges[bestEdge].child.load(memory_order_acquire);
+
+        if (child == NO_NODE) {
+            unsigned int created = allocateNode(node, edges[bestEdge].action);
+
+            if (created == NO_NODE) {
+                undoVisits(node);
+                stopFlag = true;
+                return false;
+            }
+
+            // If another thread created the child first, its node is used and this one is wasted
+            if (edges[bestEdge].child.compare_exchange_strong(child, created, memory_order_acq_rel)) {
+                child = created;
+            }
+        }
+
+        node = child;
+        addVisit(node);
+
+        int action = nodes[node].action;
+        position.move(action / 9, action % 9);
+
+        status = position.getStatus();
+
+        if (status != 0) {
+            backpropagate(node, position, (status == 1) ? 1 : ((status == 2) ? -1 : 0));
+            return true;
+        }
+    }
+
+    // Solved endgames are backed up exactly instead of being evaluated
+    if (countRemainingSpots(position) <= solverSpots) {
+        int solved = getEndgameSolver().solve(position);
+
+        if (solved != 0) {
+            backpropagate(node, position, (solved == 1) ? 1 : ((solved == 2) ? -1 : 0));
+            return true;
+        }
+    }
+
+    // Only one thread expands a leaf, the others start again
+    unsigned char expected = PARALLEL_UNEXPANDED;
+    if (!nodes[node].state.compare_exchange_strong(expected, PARALLEL_EXPANDING, memory_order_acq_rel)) {
+        undoVisits(node);
+        return false;
+    }
+
+    unsigned char actions[81];
+    int numActions = position.getValidActions(actions);
+    unsigned int firstEdge = numEdges.fetch_add(numActions);
+
+    if (firstEdge + numActions > edges.size()) {
+        nodes[node].state.store(PARALLEL_UNEXPANDED, memory_order_release);
+        undoVisits(node);
+        stopFlag = true;
+        return false;
+    }
+
+    vector<float> policy;
+    float v;
+    evaluate(position, policy, v);
+
+    // Normalize the policy over the valid moves
+    float totalValidMoves = 0;
+    for (int i = 0; i < numActions; i++) {
+        totalValidMoves += policy[actions[i]];
+    }
+
+    for (int i = 0; i < numActions; i++) {
+        parallelEdge &edge = edges[firstEdge + i];
+
+        edge.child.store(NO_NODE, memory_order_relaxed);
+        edge.action = actions[i];
+        edge.p = (totalValidMoves > 0) ? policy[actions[i]] / totalValidMoves : 1.0 / numActions;
+    }
+
+    nodes[node].firstEdge = firstEdge;
+    nodes[node].numEdges = numActions;
+    nodes[node].state.store(PARALLEL_EXPANDED, memory_order_release);
+
+    backpropagate(node, position, v);
+    return true;
+}
+
+void ParallelMCTS::worker(long long maxPlayouts, parallelStopCondition shouldStop) {
+    while (!stopFlag) {
+        if (!playout()) {
+            this_thread::yield();
+            continue;
+        }
+
+        long long done = ++playouts;
+
+        if ((maxPlayouts > 0 && done >= maxPlayouts) || (shouldStop && shouldStop(done))) {
+            stopFlag = true;
+        }
+    }
+}
+
+void ParallelMCTS::search(GameState position, long long maxPlayouts, parallelStopCondition shouldStop) {
+    numNodes = 0;
+    numEdges = 0;
+    playouts = 0;
+    stopFlag = false;
+
+    rootPosition = position;
+    rootIndex = allocateNode(NO_NODE, 0);
+    currentBatch = make_shared<evaluationBatch>();
+
+    if (position.getStatus() != 0) {
+        return;
+    }
+
+    vector<thread> threads;
+    for (int i = 0; i < max(numThreads, 1); i++) {
+        threads.push_back(thread(&ParallelMCTS::worker, this, maxPlayouts, shouldStop));
+    }
+
+    for (thread &t : threads) {
+        t.join();
+    }
+}
+
+void ParallelMCTS::search(GameState position, long long maxPlayouts) {
+    search(position, maxPlayouts, nullptr);
+}
+
+void ParallelMCTS::stop() {
+    stopFlag = true;
+}
+
+long long ParallelMCTS::getPlayouts() {
+    return playouts;
+}
+
+unsigned int ParallelMCTS::mostVisitedChild(unsigned int node) {
+    unsigned int best = NO_NODE;
+    unsigned int bestVisits = 0;
+
+    if (nodes[node].state.load(memory_order_acquire) != PARALLEL_EXPANDED) {
+        return NO_NODE;
+    }
+
+    for (unsigned int i = nodes[node].firstEdge; i < nodes[node].firstEdge + nodes[node].numEdges; i++) {
+        unsigned int child = edges[i].child.load(memory_order_acquire);
+
+        if (child != NO_NODE && nodes[child].n.load(memory_order_relaxed) > bestVisits) {
+            best = child;
+            bestVisits = nodes[child].n.load(memory_order_relaxed);
+        }
+    }
+
+    return best;
+}
+
+vector<float> ParallelMCTS::getActionProb() {
+    vector<float> result(81, 0);
+    float totalVisits = 0;
+
+    if (nodes[rootIndex].state.load(memory_order_acquire) != PARALLEL_EXPANDED) {
+        return result;
+    }
+
+    unsigned int lastEdge = nodes[rootIndex].firstEdge + nodes[rootIndex].numEdges;
+
+    for (unsigned int i = nodes[rootIndex].firstEdge; i < lastEdge; i++) {
+        unsigned int child = edges[i].child.load(memory_order_acquire);
+
+        if (child != NO_NODE) {
+            result[edges[i].action] = nodes[child].n.load(memory_order_relaxed);
+            totalVisits += result[edges[i].action];
+        }
+    }
+
+    for (float &visits : result) {
+        visits = (totalVisits > 0) ? visits / totalVisits : 0;
+    }
+
+    return result;
+}
+
+vector<int> ParallelMCTS::getPV(int maxLength) {
+    vector<int> pv;
+    unsigned int node = mostVisitedChild(rootIndex);
+
+    while (node != NO_NODE && (int) pv.size() < maxLength) {
+        pv.push_back(nodes[node].action);
+        node = mostVisitedChild(node);
+    }
+
+    return pv;
+}
+
+float ParallelMCTS::getBestValue() {
+    unsigned int best = mostVisitedChild(rootIndex);
+
+    if (best == NO_NODE) {
+        return 0;
+    }
+
+    return nodes[best].w.load(memory_order_relaxed) / nodes[best].n.load(memory_order_relaxed);
+}
+
+size_t ParallelMCTS::memoryUsage() {
+    return nodes.size() * sizeof(parallelNode) + edges.size() * sizeof(parallelEdge);
+}
@@ -0,0 +1,291 @@
+#include "ProofNumber.h"
+#include "GameState.h"
+#include <limits>
+
+using namespace std;
+
+const unsigned int pnInf = numeric_limits<unsigned int>::max() / 2;
+
+unsigned int pnAdd(unsigned int a, unsigned int b) {
+    // Saturate at infinity
+    if (a >= pnInf || b >= pnInf || a + b >= pnInf) {
+        return pnInf;
+    }
+
+    return a + b;
+}
+
+ProofNumberSearch::ProofNumberSearch() : ProofNumberSearch(PN_TABLE_SIZE_DEFAULT, PN_NODE_LIMIT_DEFAULT) {
+}
+
+ProofNumberSearch::ProofNumberSearch(int tableSize, int _nodeLimit) {
+    // Round the table size down to a power of 2 so it can be indexed with a mask
+    unsigned long long size = 2;
+    while (size * 2 <= (unsigned long long) tableSize) {
+        size *= 2;
+    }
+
+    table = vector<pnEntry>(size);
+    tableMask = size - 1;
+    nodeLimit = _nodeLimit;
+}
+
+void ProofNumberSearch::setNodeLimit(int _nodeLimit) {
+    nodeLimit = _nodeLimit;
+}
+
+void ProofNumberSearch::clear() {
+    for (pnEntry &e : table) {
+        e = pnEntry();
+    }
+}
+
+void ProofNumberSearch::lookup(unsigned long long key, unsigned int &pn, unsigned int &dn) {
+    // Each bucket is a pair of entries, see store
+    pnEntry *bucket = &table[key & tableMask & ~1ULL];
+    tableProbes++;
+
+    for (int i = 0; i < 2; i++) {
+        if (bucket[i].key == key) {
+            tableHits++;
+            pn = bucket[i].pn;
+            dn = bucket[i].dn;
+            return;
+        }
+    }
+
+    pn = 1;
+    dn = 1;
+}
+
+void ProofNumberSearch::store(unsigned long long key, unsigned int pn, unsigned int dn, unsigned int work) {
+    /**
+     * The first entry of each bucket keeps the position that took the most
+     * work and the second is always replaced. A position that was just
+     * searched is therefore always found by the next lookup.
+     */
+    pnEntry *bucket = &table[key & tableMask & ~1ULL];
+    pnEntry *e;
+
+    tableStores++;
+
+    if (bucket[0].key == key) {
+        e = &bucket[0];
+    } else if (bucket[1].key == key) {
+        e = &bucket[1];
+    } else if (work >= bucket[0].work) {
+        bucket[1] = bucket[0];
+        e = &bucket[0];
+    } else {
+        e = &bucket[1];
+    }
+
+    e->key = key;
+    e->pn = pn;
+    e->dn = dn;
+    e->work = work;
+}
+
+void ProofNumberSearch::terminalNumbers(GameState &position, unsigned int &pn, unsigned int &dn) {
+    /**
+     * Sets the proof and disproof numbers of a finished game.
+     */
+    int status = position.getStatus();
+
+    if (status == attacker || (status == 3 && drawIsWin)) {
+        pn = 0;
+        dn = pnInf;
+    } else {
+        pn = pnInf;
+        dn = 0;
+    }
+}
+
+unsigned int ProofNumberSearch::mid(GameState &position, unsigned int pnThreshold, unsigned int dnThreshold) {
+    unsigned long long key = position.hash() ^ runSalt;
+    bool orNode = position.getToMove() == attacker;
+
+    vector<GameState> children = position.allPossibleMoves();
+    int numChildren = children.size();
+    vector<unsigned long long> childKeys(numChildren);
+
+    unsigned int work = 1;
+    nodesSearched++;
+
+    // A position with no moves left is a tie
+    if (numChildren == 0) {
+        if (drawIsWin) {
+            store(key, 0, pnInf, work);
+        } else {
+            store(key, pnInf, 0, work);
+        }
+        return work;
+    }
+
+    for (int i = 0; i < numChildren; i++) {
+        childKeys[i] = children[i].hash() ^ runSalt;
+    }
+
+    while (true) {
+        unsigned int pn, dn;
+        unsigned int best1 = pnInf + 1, best2 = pnInf + 1;
+        unsigned int bestPn = 0, bestDn = 0;
+        int bestChild = -1;
+
+        // OR node: pn = min(child pn), dn = sum(child dn)
+        // AND node: pn = sum(child pn), dn = min(child dn)
+        pn = orNode ? pnInf : 0;
+        dn = orNode ? 0 : pnInf;
+
+        for (int i = 0; i < numChildren; i++) {
+            unsigned int childPn, childDn;
+
+            if (children[i].getStatus() != 0) {
+                terminalNumbers(children[i], childPn, childDn);
+            } else {
+                lookup(childKeys[i], childPn, childDn);
+            }
+
+            if (orNode) {
+                pn = min(pn, childPn);
+                dn = pnAdd(dn, childDn);
+            } else {
+                pn = pnAdd(pn, childPn);
+                dn = min(dn, childDn);
+            }
+
+            // The attacker searches the child closest to a proof, the defender the closest to a disproof
+            unsigned int selectValue = orNode ? childPn : childDn;
+
+            if (selectValue < best1) {
+                best2 = best1;
+                best1 = selectValue;
+                bestChild = i;
+                bestPn = childPn;
+                bestDn = childDn;
+            } else if (selectValue < best2) {
+                best2 = selectValue;
+            }
+        }
+
+        if (pn >= pnThreshold || dn >= dnThreshold || nodesSearched >= nodeLimit) {
+            store(key, pn, dn, work);
+            return work;
+        }
+
+        // Set the thresholds for the most promising child
+        unsigned int childPnThreshold, childDnThreshold;
+        if (orNode) {
+            childPnThreshold = min(pnThreshold, pnAdd(best2, 1));
+            childDnThreshold = pnAdd(dnThreshold - dn, bestDn);
+        } else {
+            childDnThreshold = min(dnThreshold, pnAdd(best2, 1));
+            childPnThreshold = pnAdd(pnThreshold - pn, bestPn);
+        }
+
+        work += mid(children[bestChild], childPnThreshold, childDnThreshold);
+    }
+}
+
+int ProofNumberSearch::prove(GameState position, int _attacker, bool _drawIsWin) {
+    attacker = _attacker;
+    drawIsWin = _drawIsWin;
+
+    // Keep the results of different questions apart in the table
+    runSalt = (attacker * 2 + drawIsWin) * 0x9E3779B97F4A7C15ULL;
+
+    mid(position, pnInf, pnInf);
+
+    unsigned int pn, dn;
+    lookup(position.hash() ^ runSalt, pn, dn);
+
+    if (pn == 0) {
+        return 1;
+    } else if (dn == 0) {
+        return 0;
+    }
+
+    return -1;
+}
+
+int ProofNumberSearch::solve(GameState position) {
+    int bestAction;
+    return solve(position, bestAction);
+}
+
+int ProofNumberSearch::solve(GameState position, int &bestAction) {
+    bestAction = -1;
+    nodesSearched = 0;
+
+    int status = position.getStatus();
+    if (status != 0) {
+        return status;
+    }
+
+    int toMove = position.getToMove();
+    int opponent = 2 / toMove;
+    int result;
+
+    // Can the player to move win?
+    int win = prove(position, toMove, false);
+
+    if (win == 1) {
+        result = toMove;
+    } else {
+        // Can the opponent win?
+        int loss = prove(position, opponent, false);
+
+        if (loss == 1) {
+            result = opponent;
+        } else if (win == 0 && loss == 0) {
+            result = 3;
+        } else {
+            return 0;
+        }
+    }
+
+    // Find a move that keeps the result. The table still holds the
+    // children from the last question that was asked.
+    for (GameState &child : position.allPossibleMoves()) {
+        int action = child.previousMove.board * 9 + child.previousMove.piece;
+        unsigned int pn, dn;
+
+        if (child.getStatus() != 0) {
+            terminalNumbers(child, pn, dn);
+        } else {
+            lookup(child.hash() ^ runSalt, pn, dn);
+        }
+
+        // Win: a child where the win is proven
+        // Tie: a child where the opponent's win is disproven
+        // Loss: any child, preferring ones where the loss is not yet proven
+        if ((result == toMove && pn == 0) || (result == 3 && dn == 0)) {
+            bestAction = action;
+            break;
+        }
+
+        if (result == opponent && (bestAction == -1 || pn != 0)) {
+            bestAction = action;
+        }
+    }
+
+    return result;
+}
+
+ProofNumberSearch &getEndgameSolver() {
+    thread_local ProofNumberSearch solver;
+    return solver;
+}
+
+int countRemainingSpots(GameState &position) {
+    int spots = 0;
+
+    for (int b = 0; b < 9; b++) {
+        // Claimed miniboards have result bits set and no playable spots
+        if (position.getBoardStatus(b) == 0) {
+            spots += 9 - position.board[b].count();
+        }
+    }
+
+    return spots;
+}
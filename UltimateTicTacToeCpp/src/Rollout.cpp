@@ -0,0 +1,241 @@
+#include "Rollout.h"
+#include "GameState.h"
+#include "MonteCarlo.h"
+#include <atomic>
+#include <random>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Every 3 in a row of a 9 bit miniboard mask
+const unsigned short lineMasks[8] = {0007, 0070, 0700, 0111, 0222, 0444, 0421, 0124};
+
+/**
+ * lineTable[mask] is set if the spots in the mask make a line.
+ */
+struct lineTableBuilder {
+    bool lines[512];
+
+    lineTableBuilder() {
+        for (int mask = 0; mask < 512; mask++) {
+            lines[mask] = false;
+
+            for (unsigned short line : lineMasks) {
+                lines[mask] = lines[mask] || (mask & line) == line;
+            }
+        }
+    }
+};
+
+const lineTableBuilder lineTable;
+
+inline bool hasLine(unsigned int mask) {
+    return lineTable.lines[mask];
+}
+
+/**
+ * Gets a generator with a seed of its own for a new thread, so parallel
+ * searches and self-play workers do not all play the same playouts. The
+ * count of threads seeded keeps the seeds apart even if random_device
+ * is deterministic.
+ */
+rolloutRandom newThreadRandom() {
+    static atomic<unsigned long long> threadsSeeded(0);
+    random_device device;
+    rolloutRandom rng;
+
+    rng.state = ((unsigned long long) device() << 32 | device()) ^ (++threadsSeeded * 0x9E3779B97F4A7C15ULL);
+
+    if (rng.state == 0) {
+        rng.state = ROLLOUT_SEED_DEFAULT;
+    }
+
+    return rng;
+}
+
+thread_local rolloutRandom threadRandom = newThreadRandom();
+
+void seedRollouts(unsigned long long seed) {
+    threadRandom.state = (seed != 0) ? seed : ROLLOUT_SEED_DEFAULT;
+}
+
+rolloutBoard packBoard(GameState &position) {
+    rolloutBoard board = {};
+
+    for (int b = 0; b < 9; b++) {
+        for (int s = 0; s < 9; s++) {
+            int piece = position.getPosition(b, s);
+
+            if (piece != 0) {
+                board.spots[piece - 1][b] |= 1 << s;
+            }
+        }
+
+        int status = position.getBoardStatus(b);
+
+        if (status == 1 || status == 2) {
+            board.won[status - 1] |= 1 << b;
+        }
+
+        if (status != 0) {
+            board.decided |= 1 << b;
+        }
+    }
+
+    board.requiredBoard = position.getRequiredBoard();
+    board.toMove = (position.getToMove() == 1) ? 0 : 1;
+
+    return board;
+}
+
+/**
+ * Gets the index of the nth set bit of the mask.
+ */
+inline int nthBit(unsigned int mask, unsigned int n) {
+#ifdef __BMI2__
+    return __builtin_ctz(_pdep_u32(1u << n, mask));
+#else
+    for (unsigned int i = 0; i < n; i++) {
+        mask &= mask - 1;
+    }
+
+    return __builtin_ctz(mask);
+#endif
+}
+
+int randomPlayout(rolloutBoard board, rolloutRandom &rng) {
+    if (hasLine(board.won[0]) || hasLine(board.won[1])) {
+        return hasLine(board.won[0]) ? 1 : 2;
+    }
+
+    if (board.decided == 0777) {
+        return 3;
+    }
+
+    while (true) {
+        int b, s;
+
+        // Pick a random empty spot of the required board, or of any open board
+        if (board.requiredBoard != -1) {
+            b = board.requiredBoard;
+            unsigned int empty = ~(board.spots[0][b] | board.spots[1][b]) & 0777;
+            s = nthBit(empty, rng.below(__builtin_popcount(empty)));
+        } else {
+            unsigned int empty[9];
+            unsigned int total = 0;
+
+            for (int i = 0; i < 9; i++) {
+                empty[i] = (board.decided >> i & 1) ? 0 : ~(board.spots[0][i] | board.spots[1][i]) & 0777;
+                total += __builtin_popcount(empty[i]);
+            }
+
+            unsigned int pick = rng.below(total);
+
+            for (b = 0; pick >= (unsigned int) __builtin_popcount(empty[b]); b++) {
+                pick -= __builtin_popcount(empty[b]);
+            }
+
+            s = nthBit(empty[b], pick);
+        }
+
+        int player = board.toMove;
+        board.spots[player][b] |= 1 << s;
+
+        // Same rules as GameState: a line wins the miniboard, a full miniboard is a tie
+        if (hasLine(board.spots[player][b])) {
+            board.won[player] |= 1 << b;
+            board.decided |= 1 << b;
+
+            if (hasLine(board.won[player])) {
+                return player + 1;
+            }
+        } else if ((board.spots[0][b] | board.spots[1][b]) == 0777) {
+            board.decided |= 1 << b;
+        }
+
+        if (board.decided == 0777) {
+            return 3;
+        }
+
+        board.requiredBoard = (board.decided >> s & 1) ? -1 : s;
+        board.toMove = 1 - player;
+    }
+}
+
+float randomPlayouts(rolloutBoard &board, int count, rolloutRandom &rng) {
+    int total = 0;
+
+    for (int i = 0; i < count; i++) {
+        int result = randomPlayout(board, rng);
+        total += (result == 1) ? 1 : ((result == 2) ? -1 : 0);
+    }
+
+    return (count > 0) ? (float) total / count : 0;
+}
+
+void heuristicPolicy(GameState &position, vector<float> &policy) {
+    rolloutBoard board = packBoard(position);
+    int player = board.toMove;
+
+    unsigned char actions[81];
+    int numActions = position.getValidActions(actions);
+    float total = 0;
+
+    policy.assign(81, 0);
+
+    for (int i = 0; i < numActions; i++) {
+        int b = actions[i] / 9, s = actions[i] % 9;
+        unsigned int spot = 1 << s;
+        unsigned int mine = board.spots[player][b] | spot;
+        float weight = 1;
+
+        if (hasLine(mine)) {
+            weight += HEURISTIC_WIN_BONUS;
+        } else if (hasLine(board.spots[1 - player][b] | spot)) {
+            weight += HEURISTIC_BLOCK_BONUS;
+        }
+
+        // The opponent may move anywhere if the target miniboard is decided after this move
+        bool closesBoard = hasLine(mine) || ((mine | board.spots[1 - player][b]) == 0777);
+        bool targetDecided = (board.decided >> s & 1) || (s == b && closesBoard);
+
+        if (targetDecided) {
+            weight *= HEURISTIC_FREE_MOVE_FACTOR;
+        }
+
+        policy[actions[i]] = weight;
+        total += weight;
+    }
+
+    for (int i = 0; i < numActions; i++) {
+        policy[actions[i]] /= total;
+    }
+}
+
+void uctEvaluation(uctOptions &options, GameState &position, vector<float> &policy, float &v) {
+    if (options.rolloutsPerLeaf > 0) {
+        rolloutBoard board = packBoard(position);
+        v = randomPlayouts(board, options.rolloutsPerLeaf, threadRandom);
+        policy.assign(81, 1.0 / 81);
+    } else {
+        staticEvaluation(position, policy, v);
+    }
+
+    if (options.heuristicPriors) {
+        heuristicPolicy(position, policy);
+    }
+}
+
+void uctBatchEvaluation(void *context, vector<GameState> &positions, vector<vector<float>> &policies, vector<float> &values) {
+    uctOptions &options = *((uctOptions *) context);
+
+    policies.resize(positions.size());
+    values.resize(positions.size());
+
+    for (size_t i = 0; i < positions.size(); i++) {
+        uctEvaluation(options, positions[i], policies[i], values[i]);
+    }
+}
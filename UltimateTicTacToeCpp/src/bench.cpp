@@ -0,0 +1,189 @@
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <string.h>
+#include <GameState.h>
+#include <Minimax.h>
+#include <MonteCarlo.h>
+#include <Rollout.h>
+
+using namespace std;
+
+/**
+ * Searches a fixed suite of positions with minimax, MCTS and UCT with
+ * random rollouts, and prints the node counts, speed and a signature of
+ * the results. The signature only
+ * changes if the searches behave differently, so a speed change can be
+ * checked for side effects by comparing it with the previous build.
+ *
+ * Usage: bench [depth] [playouts]
+ */
+
+// Change the version whenever the positions or the defaults change
+#define BENCH_VERSION               1
+#define BENCH_DEPTH_DEFAULT         7
+#define BENCH_PLAYOUTS_DEFAULT      2000
+
+/**
+ * Each position is a list of actions (board * 9 + piece) from the start.
+ */
+const char *benchPositions[] = {
+    "55 10",
+    "51 58 41 52",
+    "34 69 54 6 62 75",
+    "24 56 21 32 52 69 58 41",
+    "59 53 80 75 35 77 52 64 13 39",
+    "29 24 62 80 72 6 54 2 26 76 36 0",
+    "56 20 24 61 69 57 31 39 27 5 45 1 13 42",
+    "27 8 80 75 31 40 44 76 41 49 36 7 66 30 34 67",
+    "17 75 34 69 62 78 57 35 76 36 4 40 42 59 49 41 46 12",
+    "46 11 23 49 40 41 48 34 71 80 76 37 17 77 45 5 53 73 9 7",
+    "4 39 31 37 17 75 34 64 10 14 47 21 35 77 50 51 61 66 28 13 43 68",
+    "39 34 70 63 4 43 71 72 8 78 57 27 0 68 52 64 12 32 53 80 73 14 45 74",
+    "4 42 54 0 5 46 17 75 34 71 79 63 7 68 53 73 13 44 78 61 66 28 9 1 2 20",
+    "11 20 18 7 65 22 40 39 35 73 12 34 63 4 44 76 41 46 16 68 50 48 28 15 58 38 19 13",
+    "42 61 68 47 22 44 79 69 62 72 3 32 53 74 26 77 51 60 59 52 65 24 58 36 6 54 8 75 33 56",
+    "17 78 59 50 47 19 9 5 53 74 18 1 11 24 61 64 14 48 30 29 25 70 63 2 20 23 52 68 46 43 65 21",
+    "42 55 17 76 43 64 9 7 68 51 56 20 19 11 18 8 80 73 13 44 77 47 21 30 28 60 59 46 65 25 70 69 54 6",
+    "54 8 77 46 17 74 25 69 61 64 13 43 66 29 23 47 21 33 55 11 19 10 14 49 42 60 56 22 37 9 7 70 67 36 4 38",
+    "69 59 49 39 34 68 51 58 37 16 70 67 44 80 79 64 15 57 32 45 1 13 40 38 24 5 48 30 31 36 8 75 28 9 7 71 74 21",
+    "76 41 49 42 61 69 54 7 63 1 9 5 48 35 77 47 22 38 19 10 16 67 44 73 15 58 39 30 28 11 25 68 53 75 31 43 65 52 70 66",
+    "36 0 7 66 34 69 56 22 44 80 76 42 57 31 43 67 40 19 17 79 70 68 53 75 28 16 30 32 48 33 54 8 78 58 51 62 73 13 47 25 12 35",
+    "19 9 5 50 47 20 18 8 78 59 49 44 75 34 69 57 35 80 73 13 41 51 54 6 55 12 28 11 22 37 16 64 15 56 26 72 7 63 1 14 46 74 67 43",
+    "3 30 32 47 26 73 9 2 21 28 10 13 44 75 35 79 69 54 6 56 23 48 27 8 77 49 42 61 63 7 64 14 50 45 5 52 68 53 78 60 62 80 74 18 0 76",
+    "25 68 51 59 45 3 27 2 21 32 47 19 11 24 61 71 72 5 49 41 67 40 38 22 44 75 31 43 66 29 20 23 9 6 60 56 18 0 65 26 74 35 76 42 57 17 79 70",
+    "37 17 73 9 3 28 11 24 54 0 7 63 5 52 68 48 31 41 45 8 74 21 30 35 72 1 16 66 32 47 20 23 53 12 69 61 71 51 62 4 42 56 26 14 50 49 43 64 10 13",
+    "25 69",
+    "18 8 78 55",
+    "53 80 79 65 24 62",
+    "33 58 42 56 20 23 50 46",
+    "22 37 16 68 46 14 52 70 65 21",
+    "15 62 73 11 20 18 6 54 1 14 53 78",
+    "78 58 39 35 77 50 48 29 20 22 36 4 43 63",
+    "66 31 37 10 11 24 57 34 68 49 38 19 16 63 0 5",
+    "12 35 74 18 2 24 60 54 0 8 77 52 68 48 34 70 71 72",
+    "37 14 46 13 43 65 18 7 71 72 4 38 24 58 44 77 51 54 8 78",
+    "33 56 21 32 53 74 18 1 14 47 26 79 66 28 12 34 65 22 37 13 39 35",
+    "29 24 58 40 42 60 54 5 51 59 47 18 6 55 9 4 36 8 77 48 28 17 75 27",
+    "13 39 28 17 72 2 24 62 74 18 8 79 67 41 49 37 15 59 46 9 5 52 66 31 44 77",
+    "54 4 39 30 27 3 32 47 18 7 65 23 48 34 70 66 33 57 35 77 53 73 11 24 60 61 68 45",
+    "72 6 54 3 27 7 70 68 49 39 32 50 52 63 4 37 12 30 33 60 61 67 41 47 20 25 64 14 51 62"
+};
+
+const int numBenchPositions = sizeof(benchPositions) / sizeof(benchPositions[0]);
+
+unsigned long long addToSignature(unsigned long long signature, unsigned long long value) {
+    // FNV-1a
+    return (signature ^ value) * 1099511628211ULL;
+}
+
+GameState loadBenchPosition(const char *actions) {
+    GameState position;
+    istringstream stream(actions);
+    int action;
+
+    while (stream >> action) {
+        position.move(action / 9, action % 9);
+    }
+
+    return position;
+}
+
+int main(int argc, char *argv[]) {
+    int depth = (argc > 1) ? stoi(argv[1]) : BENCH_DEPTH_DEFAULT;
+    int playouts = (argc > 2) ? stoi(argv[2]) : BENCH_PLAYOUTS_DEFAULT;
+
+    constants c;
+    minimaxVerbose = false;
+
+    cout << "Bench version " << BENCH_VERSION << ": " << numBenchPositions << " positions, depth " << depth << ", " << playouts << " playouts\n";
+
+    // Minimax
+    unsigned long long minimaxSignature = 14695981039346656037ULL;
+    long long minimaxNodes = 0, minimaxUs = 0;
+
+    for (int i = 0; i < numBenchPositions; i++) {
+        GameState position = loadBenchPosition(benchPositions[i]);
+
+        searchResult result = minimaxSearchResult(position, depth, position.getToMove() == 1, c);
+        searchStats stats = getSearchStats();
+
+        minimaxNodes += stats.nodes;
+        minimaxUs += stats.elapsedUs;
+
+        float eval = result.eval;
+        unsigned int evalBits;
+        memcpy(&evalBits, &eval, sizeof(evalBits));
+
+        minimaxSignature = addToSignature(minimaxSignature, result.board.previousMove.board * 9 + result.board.previousMove.piece);
+        minimaxSignature = addToSignature(minimaxSignature, evalBits);
+        minimaxSignature = addToSignature(minimaxSignature, stats.nodes);
+    }
+
+    // MCTS
+    unsigned long long mctsSignature = 14695981039346656037ULL;
+    long long mctsPlayouts = 0;
+    vector<float> policy;
+    float v;
+
+    auto start = chrono::steady_clock::now();
+
+    for (int i = 0; i < numBenchPositions; i++) {
+        MCTS mcts;
+        mcts.startNewSearch(loadBenchPosition(benchPositions[i]));
+
+        for (int j = 0; j < playouts; j++) {
+            mcts.searchPreNN();
+
+            if (mcts.evaluationNeeded) {
+                staticEvaluation(mcts.currentPosition, policy, v);
+                mcts.searchPostNN(policy, v);
+            }
+        }
+
+        mctsPlayouts += playouts;
+
+        MCTSNode &root = mcts.getRoot();
+        for (unsigned int c = 0; c < root.numEdges; c++) {
+            mctsSignature = addToSignature(mctsSignature, mcts.getEdgeVisits(root.firstEdge + c));
+        }
+    }
+
+    long long mctsUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+    // UCT, the rollouts are seeded for each position so the signature is repeatable
+    unsigned long long uctSignature = 14695981039346656037ULL;
+    long long uctPlayouts = 0;
+    uctOptions uct;
+
+    start = chrono::steady_clock::now();
+
+    for (int i = 0; i < numBenchPositions; i++) {
+        MCTS mcts;
+        mcts.startNewSearch(loadBenchPosition(benchPositions[i]));
+
+        seedRollouts(ROLLOUT_SEED_DEFAULT);
+        mcts.runPlayouts(playouts, uctBatchEvaluation, &uct);
+
+        uctPlayouts += playouts;
+
+        MCTSNode &root = mcts.getRoot();
+        for (unsigned int c = 0; c < root.numEdges; c++) {
+            uctSignature = addToSignature(uctSignature, mcts.getEdgeVisits(root.firstEdge + c));
+        }
+    }
+
+    long long uctUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    long long rollouts = uctPlayouts * uct.rolloutsPerLeaf;
+
+    cout << "Minimax: nodes " << minimaxNodes << " time " << minimaxUs / 1000 << "ms nps " << (long long) ((minimaxUs > 0) ? minimaxNodes * 1000000.0 / minimaxUs : 0)
+         << " signature " << hex << minimaxSignature << dec << '\n';
+    cout << "MCTS:    playouts " << mctsPlayouts << " time " << mctsUs / 1000 << "ms playouts/s " << (long long) ((mctsUs > 0) ? mctsPlayouts * 1000000.0 / mctsUs : 0)
+         << " signature " << hex << mctsSignature << dec << '\n';
+    cout << "UCT:     playouts " << uctPlayouts << " time " << uctUs / 1000 << "ms rollouts/s " << (long long) ((uctUs > 0) ? rollouts * 1000000.0 / uctUs : 0)
+         << " signature " << hex << uctSignature << dec << '\n';
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <vector>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <GameState.h>
+#include <Minimax.h>
+#include <OpeningBook.h>
+
+using namespace std;
+
+/**
+ * Builds an opening book by searching every position within the first
+ * plies of the game and saving the best move for each.
+ *
+ * Usage: bookBuilder <output file> [plies] [depth] [threads]
+ */
+
+atomic<int> nextPosition(0);
+mutex entriesMtx;
+
+void bookWorker(vector<GameState> *positions, vector<bookEntry> *entries, int depth) {
+    constants c;
+
+    while (true) {
+        int index = nextPosition++;
+
+        if (index >= (int) positions->size()) {
+            return;
+        }
+
+        GameState position = positions->at(index);
+
+        // Positions are already in their canonical orientation
+        searchResult result = minimaxSearchResult(position, depth, position.getToMove() == 1, c);
+
+        bookEntry entry;
+        entry.key = position.hash();
+        entry.score = result.eval;
+        entry.action = result.board.previousMove.board * 9 + result.board.previousMove.piece;
+        entry.depth = depth;
+
+        // Count the pieces on the board to get the ply
+        entry.ply = 0;
+        for (int b = 0; b < 9; b++) {
+            for (int p = 0; p < 9; p++) {
+                if (position.getPosition(b, p) != 0) {
+                    entry.ply++;
+                }
+            }
+        }
+
+        entriesMtx.lock();
+        entries->push_back(entry);
+        if (entries->size() % 100 == 0) {
+            cout << entries->size() << " / " << positions->size() << " positions searched\n";
+        }
+        entriesMtx.unlock();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cout << "Usage: bookBuilder <output file> [plies] [depth] [threads]\n";
+        return 1;
+    }
+
+    string filename = argv[1];
+    int plies = (argc > 2) ? stoi(argv[2]) : BOOK_PLIES_DEFAULT;
+    int depth = (argc > 3) ? stoi(argv[3]) : BOOK_DEPTH_DEFAULT;
+    int numThreads = (argc > 4) ? stoi(argv[4]) : thread::hardware_concurrency();
+
+    if (numThreads < 1) {
+        numThreads = 1;
+    }
+
+    vector<GameState> positions = getBookPositions(GameState(), plies);
+    vector<bookEntry> entries;
+
+    cout << "Searching " << positions.size() << " positions to depth " << depth << " on " << numThreads << " threads\n";
+
+    auto start = chrono::high_resolution_clock::now();
+
+    vector<thread> workers;
+    for (int i = 0; i < numThreads; i++) {
+        workers.push_back(thread(bookWorker, &positions, &entries, depth));
+    }
+
+    for (thread &t : workers) {
+        t.join();
+    }
+
+    auto stop = chrono::high_resolution_clock::now();
+    auto duration = chrono::duration_cast<chrono::milliseconds>(stop - start);
+
+    if (!writeOpeningBook(filename, entries, plies)) {
+        return 1;
+    }
+
+    cout << "Wrote " << entries.size() << " entries to " << filename << " in " << duration.count() << " milliseconds\n";
+
+    return 0;
+}
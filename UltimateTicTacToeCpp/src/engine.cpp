@@ -0,0 +1,673 @@
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <math.h>
+#include <GameState.h>
+#include <Minimax.h>
+#include <MonteCarlo.h>
+#include <ParallelMCTS.h>
+#include <AsyncSearch.h>
+#include <OpeningBook.h>
+#include <ProofNumber.h>
+#include <Rollout.h>
+
+using namespace std;
+
+/**
+ * A persistent engine process speaking a line-based protocol modelled on
+ * UCI, so game servers and match harnesses can keep engines warm. The
+ * evaluation cache, solver table and MCTS tree are kept between moves,
+ * since every search runs on the same thread.
+ *
+ * Actions are board * 9 + piece.
+ *
+ * Commands:
+ *   uci                                   Prints the options, then uciok
+ *   isready                               Prints readyok
+ *   newgame                               Starts a new game with an empty MCTS tree
+ *   position startpos [moves a1 a2 ...]
+ *   go [depth N] [movetime ms] [nodes N] [infinite] [ponder]
+ *   stop
+ *   ponderhit
+ *   setoption name <name> value <value>
+ *   quit
+ *
+ * Searches print info lines while running and finish with
+ * "bestmove <action> [ponder <action>]". A go without limits searches
+ * until stop. With go ponder, the last move of the position is the
+ * expected reply, and the limits start counting on ponderhit.
+ *
+ * For MCTS, nodes is the number of playouts and depth is ignored. There
+ * is no neural network in C++, so MCTS uses staticEvaluation, or plain
+ * UCT with that many random playouts per leaf when Rollouts is above 0.
+ * HeuristicPriors replaces the uniform priors with heuristicPolicy. With
+ * more than one thread, MCTS searches a shared tree in parallel; that tree
+ * is not kept between moves.
+ */
+
+#define ENGINE_NAME                 "UltimateTicTacToe"
+#define ENGINE_INFO_INTERVAL        1000    // MCTS playouts between info lines
+#define ENGINE_PV_LENGTH            10
+
+mutex outputMtx;
+
+void send(string line) {
+    outputMtx.lock();
+    cout << line << endl;
+    outputMtx.unlock();
+}
+
+/**
+ * Runs jobs one at a time on the same thread, so thread local caches
+ * are kept from one search to the next.
+ */
+class SearchThread {
+    private:
+        thread worker;
+        mutex mtx;
+        condition_variable cv;
+        function<void()> job;
+        bool hasJob = false, busy = false, quit = false;
+
+        void loop() {
+            unique_lock<mutex> lock(mtx);
+
+            while (true) {
+                cv.wait(lock, [this]() { return hasJob || quit; });
+
+                if (quit) {
+                    return;
+                }
+
+                function<void()> current = job;
+                hasJob = false;
+                busy = true;
+
+                lock.unlock();
+                current();
+                lock.lock();
+
+                busy = false;
+                cv.notify_all();
+            }
+        }
+
+    public:
+        SearchThread() {
+            worker = thread(&SearchThread::loop, this);
+        }
+
+        ~SearchThread() {
+            mtx.lock();
+            quit = true;
+            mtx.unlock();
+
+            cv.notify_all();
+            worker.join();
+        }
+
+        void run(function<void()> newJob) {
+            wait();
+
+            mtx.lock();
+            job = newJob;
+            hasJob = true;
+            mtx.unlock();
+
+            cv.notify_all();
+        }
+
+        void wait() {
+            unique_lock<mutex> lock(mtx);
+            cv.wait(lock, [this]() { return !hasJob && !busy; });
+        }
+};
+
+class Engine {
+    private:
+        string backend = "minimax";
+        constants c;
+        float cpuct = 1;
+
+        GameState position;
+        vector<int> moves;
+
+        AsyncSearch minimax;
+
+        MCTS *mcts;
+        vector<int> treeMoves;
+
+        int threads = 1;
+        ParallelMCTS *parallel = nullptr;
+
+        // Leaf evaluation without the NN, static by default
+        uctOptions uct;
+
+        SearchThread mctsThread;
+        atomic<bool> mctsStop;
+
+        // Limits of the current MCTS search, the clock is restarted on a ponder hit
+        searchLimits mctsLimits;
+        chrono::steady_clock::time_point mctsLimitStart;
+
+        // A bestmove found while pondering is held back until ponderhit or stop
+        bool pondering = false;
+        string pendingBestMove;
+
+        void finishSearch(string bestMove);
+        void onMinimaxInfo(searchInfo info);
+
+        void goMinimax(searchLimits limits, bool ponder);
+        void goMCTS(searchLimits limits);
+        bool mctsLimitsReached(long long playouts);
+        void runMCTS();
+        void runParallelMCTS();
+
+        void stopSearch();
+
+    public:
+        Engine();
+        ~Engine();
+
+        void uci();
+        void newGame();
+        void setPosition(istringstream &command);
+        void go(istringstream &command);
+        void stop();
+        void ponderHit();
+        void setOption(istringstream &command);
+};
+
+Engine::Engine() {
+    uct.rolloutsPerLeaf = 0;
+
+    mcts = new MCTS(cpuct, 0.8, 0.5);
+    mcts->solverSpots = minimaxSolverSpots;
+    mcts->startNewSearch(position);
+    mctsStop = false;
+}
+
+Engine::~Engine() {
+    stopSearch();
+    delete mcts;
+    delete parallel;
+}
+
+void Engine::uci() {
+    send("id name " ENGINE_NAME);
+    send("option name Backend type combo default minimax var minimax var mcts");
+    send("option name OpeningBook type string default <empty>");
+    send("option name SolverSpots type spin default " + to_string(SOLVER_SPOTS_DEFAULT));
+    send("option name LeafSolverSpots type spin default " + to_string(SOLVER_LEAF_SPOTS_DEFAULT));
+    send("option name Constants type string default 2,1,10,0,0");
+    send("option name Cpuct type string default 1");
+    send("option name Threads type spin default 1");
+    send("option name Rollouts type spin default 0");
+    send("option name HeuristicPriors type check default false");
+    send("uciok");
+}
+
+void Engine::newGame() {
+    stopSearch();
+
+    position = GameState();
+    moves.clear();
+
+    delete mcts;
+    mcts = new MCTS(cpuct, 0.8, 0.5);
+    mcts->startNewSearch(position);
+    mcts->solverSpots = minimaxSolverSpots;
+    treeMoves.clear();
+}
+
+void Engine::setPosition(istringstream &command) {
+    string token;
+    command >> token;
+
+    if (token != "startpos") {
+        send("info string Unknown position " + token);
+        return;
+    }
+
+    stopSearch();
+
+    position = GameState();
+    moves.clear();
+
+    command >> token;
+    if (token != "moves") {
+        return;
+    }
+
+    int action;
+    while (command >> action) {
+        if (action < 0 || action > 80 || position.getStatus() != 0 || !position.isValidMove(action / 9, action % 9) || position.getBoardStatus(action / 9) != 0) {
+            send("info string Illegal move " + to_string(action));
+            return;
+        }
+
+        position.move(action / 9, action % 9);
+        moves.push_back(action);
+    }
+}
+
+void Engine::go(istringstream &command) {
+    searchLimits limits;
+    bool ponder = false;
+    string token;
+
+    while (command >> token) {
+        if (token == "depth") {
+            command >> limits.maxDepth;
+        } else if (token == "movetime") {
+            command >> limits.moveTimeMs;
+        } else if (token == "nodes") {
+            command >> limits.nodes;
+        } else if (token == "ponder") {
+            ponder = true;
+        } else if (token == "infinite") {
+            limits = searchLimits();
+        }
+    }
+
+    stopSearch();
+
+    if (position.getStatus() != 0) {
+        send("bestmove none");
+        return;
+    }
+
+    if (ponder && moves.empty()) {
+        send("info string Nothing to ponder on");
+        ponder = false;
+    }
+
+    pondering = ponder;
+    pendingBestMove = "";
+
+    // Book moves are played without searching
+    int bookAction;
+    if (!ponder && openingBook.probe(position, bookAction)) {
+        send("info string book move");
+        send("bestmove " + to_string(bookAction));
+        return;
+    }
+
+    if (backend == "mcts") {
+        goMCTS(limits);
+    } else {
+        goMinimax(limits, ponder);
+    }
+}
+
+void Engine::finishSearch(string bestMove) {
+    outputMtx.lock();
+
+    if (pondering) {
+        pendingBestMove = bestMove;
+    } else {
+        cout << bestMove << endl;
+    }
+
+    outputMtx.unlock();
+}
+
+void Engine::onMinimaxInfo(searchInfo info) {
+    if (info.finished) {
+        if (info.bestAction == -1) {
+            finishSearch("bestmove none");
+            return;
+        }
+
+        string bestMove = "bestmove " + to_string(info.bestAction);
+        if (info.pv.size() > 1) {
+            bestMove += " ponder " + to_string(info.pv[1]);
+        }
+
+        finishSearch(bestMove);
+        return;
+    }
+
+    ostringstream line;
+    line << "info depth " << info.depth;
+
+    if (isinf(info.eval)) {
+        line << " score mate " << ((info.eval > 0) ? info.mateDistance : -info.mateDistance);
+    } else {
+        line << " score value " << info.eval;
+    }
+
+    line << " nodes " << info.stats.nodes << " nps " << (long long) info.stats.nodesPerSecond() << " time " << info.elapsedMs << " pv";
+    for (int action : info.pv) {
+        line << ' ' << action;
+    }
+
+    send(line.str());
+}
+
+void Engine::goMinimax(searchLimits limits, bool ponder) {
+    searchCallback callback = [this](searchInfo info) {
+        onMinimaxInfo(info);
+    };
+
+    if (!ponder) {
+        minimax.start(position, limits, c, callback);
+        return;
+    }
+
+    GameState beforePonderMove;
+    for (size_t i = 0; i + 1 < moves.size(); i++) {
+        beforePonderMove.move(moves[i] / 9, moves[i] % 9);
+    }
+
+    minimax.ponder(beforePonderMove, moves.back(), limits, c, callback);
+}
+
+void Engine::goMCTS(searchLimits limits) {
+    // The position already ends with the expected reply when pondering.
+    // mctsLimitsReached ignores the limits and finishSearch holds back the
+    // bestmove until ponderhit or stop, so the search itself is the same.
+    if (threads > 1) {
+        mctsLimits = limits;
+        mctsLimitStart = chrono::steady_clock::now();
+        mctsStop = false;
+
+        mctsThread.run([this]() {
+            runParallelMCTS();
+        });
+        return;
+    }
+
+    // Keep the tree if the position follows on from the last search
+    bool followsTree = treeMoves.size() <= moves.size();
+    for (size_t i = 0; i < treeMoves.size() && followsTree; i++) {
+        followsTree = treeMoves[i] == moves[i];
+    }
+
+    if (followsTree) {
+        for (size_t i = treeMoves.size(); i < moves.size(); i++) {
+            mcts->takeAction(moves[i]);
+        }
+    } else {
+        mcts->startNewSearch(position);
+    }
+
+    treeMoves = moves;
+
+    mctsLimits = limits;
+    mctsLimitStart = chrono::steady_clock::now();
+    mctsStop = false;
+
+    mctsThread.run([this]() {
+        runMCTS();
+    });
+}
+
+bool Engine::mctsLimitsReached(long long playouts) {
+    // While pondering the limits do not apply yet
+    bool limitsApply;
+    chrono::steady_clock::time_point limitStart;
+
+    outputMtx.lock();
+    limitsApply = !pondering;
+    limitStart = mctsLimitStart;
+    outputMtx.unlock();
+
+    if (!limitsApply) {
+        return false;
+    }
+
+    long long elapsedMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - limitStart).count();
+
+    return (mctsLimits.nodes > 0 && playouts >= mctsLimits.nodes) || (mctsLimits.moveTimeMs > 0 && elapsedMs >= mctsLimits.moveTimeMs);
+}
+
+void Engine::runMCTS() {
+    vector<float> policy;
+    float v;
+    auto start = chrono::steady_clock::now();
+    long long playouts = 0;
+
+    auto sendInfo = [&](unsigned int best) {
+        long long elapsedMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+
+        ostringstream line;
+        line << "info nodes " << playouts << " nps " << ((elapsedMs > 0) ? playouts * 1000 / elapsedMs : 0) << " time " << elapsedMs;
+
+        if (best != NO_NODE && mcts->getEdgeVisits(best) > 0) {
+            line << " score value " << mcts->edges.w[best] / mcts->edges.n[best] << " pv " << (int) mcts->edges.action[best];
+        }
+
+        send(line.str());
+    };
+
+    while (!mctsStop && !mctsLimitsReached(playouts)) {
+
+        mcts->searchPreNN();
+
+        if (mcts->evaluationNeeded) {
+            uctEvaluation(uct, mcts->currentPosition, policy, v);
+            mcts->searchPostNN(policy, v);
+        }
+
+        playouts++;
+
+        if (playouts % ENGINE_INFO_INTERVAL == 0) {
+            sendInfo(mcts->getBestEdge(mcts->rootIndex));
+        }
+    }
+
+    unsigned int best = mcts->getBestEdge(mcts->rootIndex);
+    sendInfo(best);
+
+    if (best == NO_NODE) {
+        finishSearch("bestmove none");
+        return;
+    }
+
+    string bestMove = "bestmove " + to_string(mcts->edges.action[best]);
+
+    if (mcts->getEdgeVisits(best) > 0) {
+        unsigned int reply = mcts->getBestEdge(mcts->edges.child[best]);
+
+        if (reply != NO_NODE && mcts->getEdgeVisits(reply) > 0) {
+            bestMove += " ponder " + to_string(mcts->edges.action[reply]);
+        }
+    }
+
+    finishSearch(bestMove);
+}
+
+void Engine::runParallelMCTS() {
+    auto start = chrono::steady_clock::now();
+
+    auto sendInfo = [&](long long playouts) {
+        long long elapsedMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+
+        ostringstream line;
+        line << "info nodes " << playouts << " nps " << ((elapsedMs > 0) ? playouts * 1000 / elapsedMs : 0) << " time " << elapsedMs;
+
+        vector<int> pv = parallel->getPV(ENGINE_PV_LENGTH);
+        if (pv.size() > 0) {
+            line << " score value " << parallel->getBestValue() << " pv";
+            for (int action : pv) {
+                line << ' ' << action;
+            }
+        }
+
+        send(line.str());
+    };
+
+    // Called by every search thread after each playout
+    parallel->search(position, 0, [&](long long playouts) {
+        if (playouts % ENGINE_INFO_INTERVAL == 0) {
+            sendInfo(playouts);
+        }
+
+        return mctsStop || mctsLimitsReached(playouts);
+    });
+
+    sendInfo(parallel->getPlayouts());
+
+    vector<int> pv = parallel->getPV(2);
+
+    if (pv.size() == 0) {
+        finishSearch("bestmove none");
+        return;
+    }
+
+    string bestMove = "bestmove " + to_string(pv[0]);
+    if (pv.size() > 1) {
+        bestMove += " ponder " + to_string(pv[1]);
+    }
+
+    finishSearch(bestMove);
+}
+
+void Engine::ponderHit() {
+    outputMtx.lock();
+    bool wasPondering = pondering;
+    pondering = false;
+    mctsLimitStart = chrono::steady_clock::now();
+
+    // The search already finished while pondering
+    if (pendingBestMove != "") {
+        cout << pendingBestMove << endl;
+        pendingBestMove = "";
+    }
+    outputMtx.unlock();
+
+    if (wasPondering && backend != "mcts") {
+        minimax.ponderHit(moves.back());
+    }
+}
+
+void Engine::stop() {
+    outputMtx.lock();
+    pondering = false;
+
+    if (pendingBestMove != "") {
+        cout << pendingBestMove << endl;
+        pendingBestMove = "";
+    }
+    outputMtx.unlock();
+
+    stopSearch();
+}
+
+void Engine::stopSearch() {
+    minimax.stop();
+
+    mctsStop = true;
+    mctsThread.wait();
+}
+
+void Engine::setOption(istringstream &command) {
+    string token, name, value;
+
+    command >> token >> name >> token;
+    getline(command >> ws, value);
+
+    stopSearch();
+
+    if (name == "Backend") {
+        if (value != "minimax" && value != "mcts") {
+            send("info string Unknown backend " + value);
+            return;
+        }
+        backend = value;
+    } else if (name == "OpeningBook") {
+        if (value == "" || value == "<empty>") {
+            openingBook.close();
+        } else if (!loadOpeningBook(value)) {
+            send("info string Could not load opening book " + value);
+        }
+    } else if (name == "SolverSpots") {
+        minimaxSolverSpots = stoi(value);
+        mcts->solverSpots = minimaxSolverSpots;
+
+        if (parallel != nullptr) {
+            parallel->solverSpots = minimaxSolverSpots;
+        }
+    } else if (name == "LeafSolverSpots") {
+        minimaxLeafSolverSpots = stoi(value);
+    } else if (name == "Constants") {
+        char comma;
+        istringstream stream(value);
+        stream >> c.c1 >> comma >> c.c2 >> comma >> c.cw >> comma >> c.cl >> comma >> c.ct;
+    } else if (name == "Cpuct") {
+        // The tree is rebuilt with the new constant
+        cpuct = stof(value);
+        delete mcts;
+        mcts = new MCTS(cpuct, 0.8, 0.5);
+        mcts->solverSpots = minimaxSolverSpots;
+        mcts->startNewSearch(position);
+        treeMoves = moves;
+
+        if (parallel != nullptr) {
+            parallel->cpuct = cpuct;
+        }
+    } else if (name == "Threads") {
+        threads = max(stoi(value), 1);
+
+        delete parallel;
+        parallel = nullptr;
+
+        if (threads > 1) {
+            parallel = new ParallelMCTS(threads, cpuct, PARALLEL_MAX_NODES_DEFAULT);
+            parallel->solverSpots = minimaxSolverSpots;
+            parallel->setEvaluator(uctBatchEvaluation, &uct);
+        }
+    } else if (name == "Rollouts") {
+        uct.rolloutsPerLeaf = max(stoi(value), 0);
+    } else if (name == "HeuristicPriors") {
+        uct.heuristicPriors = (value == "true");
+    } else {
+        send("info string Unknown option " + name);
+    }
+}
+
+int main() {
+    Engine engine;
+    string line;
+
+    // Searches report through info lines instead
+    minimaxVerbose = false;
+
+    while (getline(cin, line)) {
+        istringstream command(line);
+        string token;
+        command >> token;
+
+        if (token == "uci") {
+            engine.uci();
+        } else if (token == "isready") {
+            send("readyok");
+        } else if (token == "newgame") {
+            engine.newGame();
+        } else if (token == "position") {
+            engine.setPosition(command);
+        } else if (token == "go") {
+            engine.go(command);
+        } else if (token == "stop") {
+            engine.stop();
+        } else if (token == "ponderhit") {
+            engine.ponderHit();
+        } else if (token == "setoption") {
+            engine.setOption(command);
+        } else if (token == "quit") {
+            break;
+        } else if (token != "") {
+            send("info string Unknown command " + token);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <vector>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <GameState.h>
+#include <Minimax.h>
+#include <Match.h>
+#include <Labeler.h>
+
+using namespace std;
+
+/**
+ * Labels positions with minimax scores, best moves and principal variations.
+ * The positions file has one position per line as a list of actions, the
+ * same format as match openings. Running the same command again after an
+ * interruption continues where it stopped.
+ *
+ * Usage: label <positions file> <output file> [-depth N] [-time ms] [-threads N] [-restart]
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        cout << "Usage: label <positions file> <output file> [-depth N] [-time ms] [-threads N] [-restart]\n";
+        return 1;
+    }
+
+    string positionsFile = argv[1];
+    string outputFile = argv[2];
+
+    labelOptions options;
+    options.numThreads = thread::hardware_concurrency();
+
+    for (int i = 3; i < argc; i++) {
+        string option = argv[i];
+
+        if (option == "-restart") {
+            options.resume = false;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            cout << "Missing value for " << option << '\n';
+            return 1;
+        }
+
+        string value = argv[++i];
+
+        if (option == "-depth") {
+            options.depth = stoi(value);
+        } else if (option == "-time") {
+            options.timeMs = stoi(value);
+        } else if (option == "-threads") {
+            options.numThreads = stoi(value);
+        } else {
+            cout << "Unknown option " << option << '\n';
+            return 1;
+        }
+    }
+
+    // Records keep the line of their position, so a resume finds them even if lines were skipped
+    vector<unsigned int> lines;
+    vector<GameState> positions = loadOpenings(positionsFile, lines);
+
+    if (options.timeMs > 0) {
+        cout << "Labeling " << positions.size() << " positions with " << options.timeMs << "ms each on " << options.numThreads << " threads\n";
+    } else {
+        cout << "Labeling " << positions.size() << " positions to depth " << options.depth << " on " << options.numThreads << " threads\n";
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    long long labeled = labelPositions(positions, lines, outputFile, options);
+
+    if (labeled < 0) {
+        return 1;
+    }
+
+    auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+    cout << "Labeled " << labeled << " positions in " << duration.count() << " milliseconds\n";
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <GameState.h>
+#include <Minimax.h>
+#include <Match.h>
+
+using namespace std;
+
+/**
+ * Plays two minimax engines against each other until the SPRT decides
+ * which is stronger.
+ *
+ * Usage: match [-games N] [-threads N] [-openings N] [-openingsFile file] [-plies N]
+ *              [-elo0 x] [-elo1 x] [-alpha x] [-beta x]
+ *              [-depth1 N] [-depth2 N] [-constants1 c1,c2,cw,cl,ct] [-constants2 c1,c2,cw,cl,ct]
+ *
+ * Exits with 0 if H1 is accepted, 2 if H0 is accepted, 3 if the games ran
+ * out first, and 1 for a bad option.
+ */
+
+#define EXIT_H1_ACCEPTED            0
+#define EXIT_BAD_OPTION             1
+#define EXIT_H0_ACCEPTED            2
+#define EXIT_NO_DECISION            3
+
+constants parseConstants(string value) {
+    constants c;
+    char comma;
+    istringstream stream(value);
+
+    stream >> c.c1 >> comma >> c.c2 >> comma >> c.cw >> comma >> c.cl >> comma >> c.ct;
+
+    return c;
+}
+
+int main(int argc, char *argv[]) {
+    engineConfig a, b;
+    matchOptions options;
+    options.numThreads = thread::hardware_concurrency();
+
+    int numOpenings = MATCH_OPENINGS_DEFAULT;
+    int plies = MATCH_OPENING_PLIES;
+    string openingsFile = "";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        string value = argv[i + 1];
+
+        if (option == "-games") {
+            options.maxGames = stoi(value);
+        } else if (option == "-threads") {
+            options.numThreads = stoi(value);
+        } else if (option == "-openings") {
+            numOpenings = stoi(value);
+        } else if (option == "-openingsFile") {
+            openingsFile = value;
+        } else if (option == "-plies") {
+            plies = stoi(value);
+        } else if (option == "-elo0") {
+            options.elo0 = stod(value);
+        } else if (option == "-elo1") {
+            options.elo1 = stod(value);
+        } else if (option == "-alpha") {
+            options.alpha = stod(value);
+        } else if (option == "-beta") {
+            options.beta = stod(value);
+        } else if (option == "-depth1") {
+            a.depth = stoi(value);
+        } else if (option == "-depth2") {
+            b.depth = stoi(value);
+        } else if (option == "-constants1") {
+            a.c = parseConstants(value);
+        } else if (option == "-constants2") {
+            b.c = parseConstants(value);
+        } else {
+            cout << "Unknown option " << option << '\n';
+            return EXIT_BAD_OPTION;
+        }
+    }
+
+    vector<GameState> openings;
+    if (openingsFile != "") {
+        openings = loadOpenings(openingsFile);
+    } else {
+        openings = generateOpenings(numOpenings, plies, 0);
+    }
+
+    cout << "Playing up to " << options.maxGames << " games from " << openings.size() << " openings on " << options.numThreads << " threads\n";
+
+    matchResults results = runMatch(a, b, openings, options);
+
+    if (results.sprtResult == 1) {
+        return EXIT_H1_ACCEPTED;
+    } else if (results.sprtResult == -1) {
+        return EXIT_H0_ACCEPTED;
+    }
+
+    return EXIT_NO_DECISION;
+}